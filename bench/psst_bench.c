@@ -0,0 +1,604 @@
+/*
+ * psst_bench.c: sampling self-overhead against a mock hardware root
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "parse_config.h"
+#include "psst.h"
+#include "logger.h"
+#include "perf_msr.h"
+#include "fallback.h"
+#include "idle_skip.h"
+#include "shm_export.h"
+#include "rollup.h"
+#include "os_stats.h"
+#include "derive.h"
+
+/*
+ * make bench: one row per cpu count & poll period, each run in a child of
+ * its own (the logger sizes its header & pages once per process):
+ *	sample	ns of one log_sample(), i.e. what do_logging() costs when due
+ *	perf	ns of update_perf_diffs() alone, the per-cpu MSR reads
+ *	syscalls	file syscalls per sample, the io thread's page writes
+ *		included
+ *	bytes	log record bytes per sample
+ *	cpu	sample over the poll period: share of a cpu spent sampling
+ *	check	ns of do_logging() when no sample is due, every ON loop pass
+ *	shape	ns of power_shaping(), every ON loop pass
+ * The hardware is a tree of tmpfs files read through --hw-root: a sparse
+ * /dev/cpu/N/msr per cpu (offset = register, as the msr driver) advanced
+ * through a shared mapping, and RAPL, thermal zone, coretemp and cpu sysfs
+ * nodes. MPERF (0xe7) and APERF (0xe8) overlap in a flat file, so APERF
+ * reads as MPERF >> 8 and Freq is not realistic. The cost is.
+ * psst options after -- apply to every row, e.g. -- -S --os-stats.
+ */
+#define BENCH_SAMPLES (256)
+#define BENCH_PASSES (1000)	/* do_logging() & power_shaping() calls */
+#define BENCH_MAX_LIST (16)
+#define MOCK_MSR_BYTES (4096)
+#define MOCK_TSC_KHZ (2400000ULL)
+#define MOCK_HFM_RATIO (24)
+#define MOCK_IDLE_STATES (2)
+#define MOCK_BASE_LEN (40)
+#define MOCK_REL_LEN (256)
+
+static const int def_cpus[] = {4, 16, 64, 256, 1024};
+static const int def_polls[] = {1, 10, 100, 1000};
+
+enum mock_rapl { MOCK_PKG, MOCK_CORE, MOCK_DRAM, NR_MOCK_RAPL };
+
+static const struct {
+	const char *dir, *name;
+	uint64_t uj_per_ms;
+} rapl_node[NR_MOCK_RAPL] = {
+	{":0/", "package-0", 15000},
+	{":0/intel-rapl:0:0/", "core", 8000},
+	{":0/intel-rapl:0:1/", "dram", 2000},
+};
+
+struct mock_cpu {
+	char *msr;		/* shared mapping of its msr file */
+	uint64_t tsc, mperf, pperf;
+	double load;		/* C0 [%] */
+};
+
+static char root[64];
+static struct mock_cpu *mc;
+static int nr_mc;
+static int rapl_fd[NR_MOCK_RAPL];
+static uint64_t rapl_uj[NR_MOCK_RAPL];
+
+/* file syscalls, counted while the sampler is timed and for log writes */
+static __thread int counting;
+static int bench_running;
+static uint64_t nr_syscalls;
+
+static void count_syscall(int fd)
+{
+	if (counting || (__atomic_load_n(&bench_running, __ATOMIC_RELAXED) &&
+				fd == configpv.log_file_fd))
+		__atomic_add_fetch(&nr_syscalls, 1, __ATOMIC_RELAXED);
+}
+
+/* linked with -Wl,--wrap=<call>, see Makefile */
+extern int __real_open(const char *path, int flags, ...);
+extern int __real_close(int fd);
+extern ssize_t __real_read(int fd, void *buf, size_t n);
+extern ssize_t __real_pread(int fd, void *buf, size_t n, off_t off);
+extern ssize_t __real_write(int fd, const void *buf, size_t n);
+extern ssize_t __real_pwrite(int fd, const void *buf, size_t n, off_t off);
+extern off_t __real_lseek(int fd, off_t off, int whence);
+
+int __wrap_open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	count_syscall(-1);
+	return __real_open(path, flags, mode);
+}
+
+int __wrap_close(int fd)
+{
+	count_syscall(fd);
+	return __real_close(fd);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t n)
+{
+	count_syscall(fd);
+	return __real_read(fd, buf, n);
+}
+
+ssize_t __wrap_pread(int fd, void *buf, size_t n, off_t off)
+{
+	count_syscall(fd);
+	return __real_pread(fd, buf, n, off);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t n)
+{
+	count_syscall(fd);
+	return __real_write(fd, buf, n);
+}
+
+ssize_t __wrap_pwrite(int fd, const void *buf, size_t n, off_t off)
+{
+	count_syscall(fd);
+	return __real_pwrite(fd, buf, n, off);
+}
+
+off_t __wrap_lseek(int fd, off_t off, int whence)
+{
+	count_syscall(fd);
+	return __real_lseek(fd, off, whence);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		perror("clock_gettime");
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* parent directories of path, like mkdir -p `dirname path` */
+static int mkdir_parents(char *path)
+{
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	return 0;
+}
+
+/* <root>/<rel> holding the text, open for rewrites */
+static int mock_file(const char *rel, const char *fmt, ...)
+{
+	char path[MAX_LEN], text[64];
+	va_list ap;
+	int fd, sz;
+
+	snprintf(path, sizeof(path), "%s%s", root, rel);
+	if (mkdir_parents(path))
+		return -1;
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror(path);
+		return -1;
+	}
+	va_start(ap, fmt);
+	sz = vsnprintf(text, sizeof(text), fmt, ap);
+	va_end(ap);
+	if (pwrite(fd, text, sz, 0) != sz) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* read-only node <dir><node> */
+static int mock_node(const char *dir, const char *node, const char *text)
+{
+	char rel[MOCK_REL_LEN];
+	int fd;
+
+	snprintf(rel, sizeof(rel), "%s%s", dir, node);
+	fd = mock_file(rel, "%s\n", text);
+	if (fd == -1)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+static void mock_msr_set(char *msr, uint32_t reg, uint64_t v)
+{
+	memcpy(msr + reg, &v, sizeof(v));
+}
+
+/* counters of every cpu & energy of every domain, ms later */
+static void mock_advance(int ms)
+{
+	uint64_t dt = ms * MOCK_TSC_KHZ, dm;
+	char text[32];
+	int t, r, sz;
+
+	for (t = 0; t < nr_mc; t++) {
+		dm = dt * mc[t].load / 100;
+		mc[t].tsc += dt;
+		mc[t].mperf += dm;
+		mc[t].pperf += dm * 9 / 10;
+		mock_msr_set(mc[t].msr, MSR_IA32_TSC, mc[t].tsc);
+		/* APERF is the upper 7 bytes of this */
+		mock_msr_set(mc[t].msr, MSR_IA32_MPERF, mc[t].mperf);
+		mock_msr_set(mc[t].msr, MSR_IA32_PPERF, mc[t].pperf);
+	}
+	for (r = 0; r < NR_MOCK_RAPL; r++) {
+		rapl_uj[r] += rapl_node[r].uj_per_ms * ms;
+		sz = sprintf(text, "%llu\n", (unsigned long long)rapl_uj[r]);
+		if (pwrite(rapl_fd[r], text, sz, 0) != sz)
+			perror("mock energy_uj");
+	}
+}
+
+static int mock_cpus(int n)
+{
+	char rel[MOCK_REL_LEN], dir[MOCK_REL_LEN / 2], path[MAX_LEN];
+	int t, s, fd;
+
+	mc = calloc(n, sizeof(struct mock_cpu));
+	if (!mc) {
+		perror("calloc mock cpus");
+		return 0;
+	}
+	for (t = 0; t < n; t++) {
+		snprintf(path, sizeof(path), "%s/dev/cpu/%d/msr", root, t);
+		if (mkdir_parents(path))
+			return 0;
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1 || ftruncate(fd, MOCK_MSR_BYTES)) {
+			perror(path);
+			return 0;
+		}
+		mc[t].msr = mmap(NULL, MOCK_MSR_BYTES, PROT_READ | PROT_WRITE,
+							MAP_SHARED, fd, 0);
+		close(fd);
+		if (mc[t].msr == MAP_FAILED) {
+			perror("mmap mock msr");
+			return 0;
+		}
+		/* a mix of busy cpus and some all but idle ones */
+		mc[t].load = t % 4 == 3 ? 0.5 : 20 + (t * 37) % 70;
+		mock_msr_set(mc[t].msr, MSR_PLATFORM_INFO, MOCK_HFM_RATIO << 8);
+
+		snprintf(rel, sizeof(rel), "%s/cpu%d/cpufreq/scaling_cur_freq",
+							SYSFS_CPU_PATH, t);
+		fd = mock_file(rel, "%llu\n", MOCK_TSC_KHZ);
+		if (fd == -1)
+			return 0;
+		close(fd);
+		for (s = 0; s < MOCK_IDLE_STATES; s++) {
+			snprintf(dir, sizeof(dir), "%s/cpu%d/cpuidle/state%d/",
+							SYSFS_CPU_PATH, t, s);
+			if (!mock_node(dir, "name", s ? "C1" : "POLL") ||
+			    !mock_node(dir, "usage", "1000") ||
+			    !mock_node(dir, "time", "100000"))
+				return 0;
+		}
+	}
+	nr_mc = n;
+	return 1;
+}
+
+/* RAPL domains, package thermal zone & coretemp */
+static int mock_tree(void)
+{
+	char dir[MOCK_REL_LEN / 2], rel[MOCK_REL_LEN];
+	int r;
+
+	for (r = 0; r < NR_MOCK_RAPL; r++) {
+		snprintf(dir, sizeof(dir), "%s%s", BASE_PATH_RAPL,
+							rapl_node[r].dir);
+		if (!mock_node(dir, "name", rapl_node[r].name))
+			return 0;
+		snprintf(rel, sizeof(rel), "%senergy_uj", dir);
+		rapl_fd[r] = mock_file(rel, "0\n");
+		if (rapl_fd[r] == -1)
+			return 0;
+	}
+	return mock_node(BASE_PATH_TZONE "0/", "type", "x86_pkg_temp") &&
+	       mock_node(BASE_PATH_TZONE "0/", "temp", "45000") &&
+	       mock_node(BASE_PATH_CPUDTS "/hwmon/hwmon0/", "name", "coretemp") &&
+	       mock_node(BASE_PATH_CPUDTS "/hwmon/hwmon0/", "temp2_input",
+								"47000");
+}
+
+static int remove_node(const char *path, const struct stat *sb, int flag,
+		       struct FTW *ftw)
+{
+	UNUSED(sb);
+	UNUSED(flag);
+	UNUSED(ftw);
+	if (remove(path))
+		perror(path);
+	return 0;
+}
+
+/* one row: cpus mock cpus sampled every poll ms */
+static int run_one(int cpus, int poll, int samples, FILE *out)
+{
+	struct timespec epoch, tm;
+	pthread_t io_thread;
+	data_t shape;
+	ps_t ps;
+	uint64_t t0, bytes, sample_ns = 0, perf_ns = 0, check_ns, shape_ns;
+	float dc = 10, v_unit = MIN_LOAD, sum;
+	int t, i;
+
+	if (!mock_cpus(cpus) || !mock_tree())
+		return 0;
+
+	/* psst options from the command line, then what the row sets */
+	configpv.verbose = 0;
+	configpv.poll_period = poll;
+	snprintf(configpv.hw_root, sizeof(configpv.hw_root), "%s", root);
+	snprintf(configpv.log_file_name, sizeof(configpv.log_file_name),
+							"%s/psst.csv", root);
+	CPU_ZERO(&configpv.cpumask);
+	for (t = 0; t < cpus; t++)
+		CPU_SET(t, &configpv.cpumask);
+	cpu_stress_opt = WELL_DEFINED;
+	if (!populate_default_config(&configpv))
+		return 0;
+
+	nr_threads = cpus;
+	perf_stats = malloc(sizeof(perf_stats_t) * nr_threads);
+	if (!perf_stats || !init_delta_vars(nr_threads))
+		return 0;
+	for (t = 0; t < nr_threads; t++) {
+		perf_stats[t].cpu = t;
+		perf_stats[t].dev_msr_fd = initialize_dev_msr(t);
+		perf_stats[t].dev_msr_supported = 1;
+		if (perf_stats[t].dev_msr_fd < 0)
+			return 0;
+	}
+	if (initialize_cpu_hfm_mhz(perf_stats[0].dev_msr_fd) ||
+	    !initialize_fallback(&configpv, 1) ||
+	    !initialize_idle_skip(&configpv) ||
+	    !initialize_rollup(&configpv) ||
+	    !initialize_os_stats(&configpv) ||
+	    !initialize_derive(&configpv))
+		return 0;
+	if (!initialize_shm_export(&configpv))
+		fprintf(out, "no shm export\n");
+	if (pthread_create(&io_thread, NULL, (void *)&page_write_disk,
+							(void *)&configpv)) {
+		perror("io thread create");
+		return 0;
+	}
+
+	if (!parse_power_shape(configpv.shape_func, &shape))
+		return 0;
+	ps.psn = shape.psn;
+	ps.psa = shape.psa;
+	ps.begin.tv_sec = 0;
+	if (clock_gettime(CLOCK_MONOTONIC, &ps.last))
+		perror("clock_gettime");
+
+	/* first reads, then the header sample */
+	if (clock_gettime(CLOCK_MONOTONIC, &epoch))
+		perror("clock_gettime");
+	mock_advance(poll);
+	initialize_sampling(&epoch);
+	mock_advance(poll);
+	/* sample time runs a second ahead of the clock from here on */
+	if (clock_gettime(CLOCK_MONOTONIC, &tm))
+		perror("clock_gettime");
+	timespec_add_ns(&tm, NSEC_PER_SEC);
+	log_sample(dc, &tm);
+
+	/* never due: the last sample is in the future */
+	t0 = now_ns();
+	for (i = 0; i < BENCH_PASSES; i++)
+		do_logging(dc);
+	check_ns = (now_ns() - t0) / BENCH_PASSES;
+
+	t0 = now_ns();
+	for (i = 0; i < BENCH_PASSES; i++)
+		power_shaping(&ps, &v_unit);
+	shape_ns = (now_ns() - t0) / BENCH_PASSES;
+
+	bytes = log_record_bytes;
+	__atomic_store_n(&bench_running, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < samples; i++) {
+		mock_advance(poll);
+		timespec_add_ns(&tm, poll * 1000000ULL);
+		counting = 1;
+		t0 = now_ns();
+		log_sample(dc, &tm);
+		sample_ns += now_ns() - t0;
+		counting = 0;
+	}
+	__atomic_store_n(&bench_running, 0, __ATOMIC_RELAXED);
+	bytes = log_record_bytes - bytes;
+
+	for (i = 0; i < samples; i++) {
+		mock_advance(poll);
+		t0 = now_ns();
+		update_perf_diffs(&sum);
+		perf_ns += now_ns() - t0;
+	}
+
+	fprintf(out, "%5d %8d %10.0f %9.0f %8.2f %6.0f %7.3f %9llu %9llu\n",
+		cpus, poll, (double)sample_ns / samples,
+		(double)perf_ns / samples,
+		(double)__atomic_load_n(&nr_syscalls, __ATOMIC_RELAXED) /
+								samples,
+		(double)bytes / samples,
+		(double)sample_ns / samples / (poll * 10000.0),
+		(unsigned long long)check_ns, (unsigned long long)shape_ns);
+	return 1;
+}
+
+static int parse_list(char *arg, int *list, int min, int max)
+{
+	char *token, *save;
+	int n = 0;
+
+	for (token = strtok_r(arg, ",", &save); token;
+				token = strtok_r(NULL, ",", &save)) {
+		if (n == BENCH_MAX_LIST)
+			return 0;
+		list[n] = atoi(token);
+		if (list[n] < min || list[n] > max)
+			return 0;
+		n++;
+	}
+	return n;
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [options] [-- psst options]\n", prog);
+	printf("\t-c\t<N[,N..]> mock cpu counts (default: 4,16,64,256,1024)\n");
+	printf("\t-p\t<ms[,ms..]> poll periods (default: 1,10,100,1000)\n");
+	printf("\t-n\t<N> samples per row (default: %d)\n", BENCH_SAMPLES);
+	printf("\t-d\t</path> where the mock trees go (default: /dev/shm, else /tmp)\n");
+	printf("\tpsst options apply to every row, e.g. -- -S --os-stats --rollup 1000\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int cpus[BENCH_MAX_LIST], polls[BENCH_MAX_LIST];
+	int nr_cpus = 0, nr_polls = 0, samples = BENCH_SAMPLES;
+	int c, p, i, status, ret = 0;
+	char base[MOCK_BASE_LEN] = "";
+	char **av;
+	FILE *out;
+	pid_t pid;
+
+	while ((c = getopt(argc, argv, "c:p:n:d:h")) != -1) {
+		switch (c) {
+		case 'c':
+			nr_cpus = parse_list(optarg, cpus, 1, CPU_SETSIZE);
+			if (!nr_cpus) {
+				printf("-c expects 1..%d[,..]\n", CPU_SETSIZE);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'p':
+			nr_polls = parse_list(optarg, polls, 1, 3600000);
+			if (!nr_polls) {
+				printf("-p expects ms[,ms..]\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'n':
+			samples = atoi(optarg);
+			if (samples <= 0) {
+				printf("-n expects a sample count\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'd':
+			if (strlen(optarg) >= sizeof(base)) {
+				printf("-d expects a path under %d characters\n",
+							MOCK_BASE_LEN);
+				exit(EXIT_FAILURE);
+			}
+			strcpy(base, optarg);
+			break;
+		default:
+			usage(argv[0]);
+			exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if (!nr_cpus) {
+		nr_cpus = sizeof(def_cpus) / sizeof(def_cpus[0]);
+		memcpy(cpus, def_cpus, sizeof(def_cpus));
+	}
+	if (!nr_polls) {
+		nr_polls = sizeof(def_polls) / sizeof(def_polls[0]);
+		memcpy(polls, def_polls, sizeof(def_polls));
+	}
+	if (!base[0])
+		strcpy(base, access("/dev/shm", W_OK) ? "/tmp" : "/dev/shm");
+
+	/* whatever follows -- is handed to psst's own parser */
+	av = calloc(argc - optind + 2, sizeof(char *));
+	if (!av) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	av[0] = "psst";
+	for (i = optind; i < argc; i++)
+		av[i - optind + 1] = argv[i];
+	c = argc - optind + 1;
+	optind = 0;
+	if (!parse_cmd_config(c, av, &configpv)) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("# psst self-overhead: %d samples per row, mock hardware in %s\n",
+							samples, base);
+	printf("# cpus poll[ms] sample[ns]  perf[ns] syscalls  bytes  cpu[%%] check[ns] shape[ns]\n");
+	for (c = 0; c < nr_cpus; c++) {
+		for (p = 0; p < nr_polls; p++) {
+			fflush(stdout);
+			pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				exit(EXIT_FAILURE);
+			}
+			if (!pid) {
+				/* psst's own prints stay out of the table */
+				out = fdopen(dup(STDOUT_FILENO), "w");
+				if (!out || !freopen("/dev/null", "w", stdout))
+					_exit(EXIT_FAILURE);
+				snprintf(root, sizeof(root),
+					"%s/psst-bench.XXXXXX", base);
+				if (!mkdtemp(root)) {
+					perror(root);
+					_exit(EXIT_FAILURE);
+				}
+				i = run_one(cpus[c], polls[p], samples, out);
+				if (!i)
+					fprintf(out, "%5d %8d failed\n",
+							cpus[c], polls[p]);
+				nftw(root, remove_node, 16,
+						FTW_DEPTH | FTW_PHYS);
+				fclose(out);
+				_exit(i ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+			if (waitpid(pid, &status, 0) == -1 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status))
+				ret = 1;
+		}
+	}
+	free(av);
+	return ret;
+}
@@ -0,0 +1,131 @@
+/*
+ * adaptive.c: poll period following how fast the signals change
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <math.h>
+#include "adaptive.h"
+#include "logger.h"
+
+/*
+ * --adaptive-poll floor,ceiling: every sample, Freq, Load and package (or
+ * core) power are tested against an EWMA of their mean and variance. A
+ * signal more than ADAPT_SIGMAS standard deviations and ADAPT_MIN_CHANGE
+ * of its mean away is a transient: the poll period drops to floor at once.
+ * After ADAPT_HOLD steady samples in a row it doubles, up to ceiling.
+ * The Poll column logs the interval each sample actually covered.
+ */
+enum adapt_signal { AS_FREQ, AS_LOAD, AS_POWER, NR_AS };
+
+struct ewma {
+	int col;	/* -1: not logged */
+	int warm;
+	double mean, var;
+};
+
+static int adapt_enabled;
+static struct ewma sig[NR_AS];
+static int floor_ms, ceil_ms, cur_ms;
+static int steady;
+static unsigned long long nr_samples, nr_floor;
+
+int initialize_adaptive(struct config *cfg)
+{
+	int s;
+
+	if (!cfg->adapt_floor_ms)
+		return 1;
+	if (cfg->step_period_ms) {
+		printf("--adaptive-poll excludes --step-response\n");
+		return 0;
+	}
+
+	floor_ms = cfg->adapt_floor_ms;
+	ceil_ms = cfg->adapt_ceil_ms;
+	sig[AS_FREQ].col = FREQ_REALIZED;
+	sig[AS_LOAD].col = LOAD_REALIZED;
+	sig[AS_POWER].col = col_desc[PKG0_POWER_RAPL].report_enabled ?
+				PKG0_POWER_RAPL : PP0_POWER_RAPL;
+	for (s = 0; s < NR_AS; s++) {
+		if (!col_desc[sig[s].col].report_enabled)
+			sig[s].col = -1;
+	}
+
+	/* start fast: nothing is known about the signals yet */
+	cur_ms = floor_ms;
+	set_poll_period(cur_ms);
+	col_desc[POLL_PERIOD].report_enabled = 1;
+	adapt_enabled = 1;
+	return 1;
+}
+
+/* 1 if x is off the running mean & variance, which then take x in */
+static int ewma_change(struct ewma *e, double x)
+{
+	double d = x - e->mean;
+	int change;
+
+	if (!e->warm) {
+		e->mean = x;
+		e->var = 0;
+		e->warm = 1;
+		return 0;
+	}
+	change = d * d > ADAPT_SIGMAS * ADAPT_SIGMAS * e->var &&
+			fabs(d) > ADAPT_MIN_CHANGE * fabs(e->mean);
+	e->mean += ADAPT_ALPHA * d;
+	e->var = (1 - ADAPT_ALPHA) * (e->var + ADAPT_ALPHA * d * d);
+	return change;
+}
+
+/* sampling context, once a record's column values are final */
+void adaptive_sample(void)
+{
+	int s, change = 0;
+
+	if (!adapt_enabled || exit_cpu_thread)
+		return;
+
+	for (s = 0; s < NR_AS; s++) {
+		if (sig[s].col >= 0)
+			change |= ewma_change(&sig[s],
+					col_desc[sig[s].col].value);
+	}
+
+	nr_samples++;
+	/* --control or a --scenario phase may have set a period meanwhile */
+	cur_ms = configpv.poll_period;
+	if (change) {
+		steady = 0;
+		cur_ms = floor_ms;
+	} else if (++steady >= ADAPT_HOLD) {
+		steady = 0;
+		cur_ms = cur_ms * 2 < ceil_ms ? cur_ms * 2 : ceil_ms;
+	}
+	if (cur_ms <= floor_ms)
+		nr_floor++;
+	if (cur_ms != configpv.poll_period)
+		set_poll_period(cur_ms);
+}
+
+void finish_adaptive(void)
+{
+	if (!adapt_enabled || !nr_samples)
+		return;
+	printf("adaptive poll: %llu samples, %.1f%% at %dms\n",
+		nr_samples, (double)nr_floor * 100 / nr_samples, floor_ms);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _ADAPTIVE_H_
+#define _ADAPTIVE_H_
+#include "parse_config.h"
+
+/* EWMA weight of a sample, and the change test */
+#define ADAPT_ALPHA (0.25)
+#define ADAPT_SIGMAS (3.0)
+#define ADAPT_MIN_CHANGE (0.02)
+/* steady samples before the period is doubled */
+#define ADAPT_HOLD (4)
+
+extern int initialize_adaptive(struct config *cfg);
+extern void adaptive_sample(void);
+extern void finish_adaptive(void);
+#endif
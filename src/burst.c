@@ -0,0 +1,388 @@
+/*
+ * burst.c: triggered sub-ms capture of raw counters (--burst, --trigger)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include "burst.h"
+#include "control.h"
+#include "logger.h"
+#include "perf_msr.h"
+#include "sampler.h"
+
+/*
+ * A thread of its own reads raw counters every --burst period into a
+ * ring: package energy, x86_pkg_temp and aperf/mperf/tsc of every cpu.
+ * Nothing is written while triggers stay quiet. When one fires, the ring
+ * keeps filling for the post window, then pre + post window records go to
+ * <log-file>.burst-NNN, raw and with derived power, frequency and load,
+ * and a #mark in the regular log points at the file.
+ *
+ * Triggers (--trigger, repeatable) fire on the false -> true transition:
+ *	shape		any worker got a new shape (--control, --scenario, ..)
+ *			or a single-pulse/stair-case edge moved its duty
+ *	power>MW	package power over TRIGGER_SPAN_US above MW
+ *	temp+C		x86_pkg_temp up by C DegC within TRIGGER_LOOKBACK_MS
+ *	freq-MHZ	mean frequency down by MHZ within TRIGGER_LOOKBACK_MS
+ *
+ * With --sampler-cpu the thread runs there and its cpu time is charged
+ * to that cpu's worker like the sampler's own.
+ */
+#define TRIGGER_SPAN_US (1000)
+#define TRIGGER_LOOKBACK_MS (10)
+#define REC_T		(0)
+#define REC_ENERGY	(1)
+#define REC_TEMP	(2)
+#define REC_CPU		(3)	/* then aperf, mperf, tsc per cpu */
+
+enum trigger_type { TRIG_SHAPE, TRIG_POWER, TRIG_TEMP, TRIG_FREQ };
+
+struct trigger {
+	enum trigger_type type;
+	double value;
+	int armed;
+	char desc[32];
+};
+
+static struct trigger triggers[MAX_TRIGGERS];
+static int nr_triggers;
+static int burst_enabled;
+static int period_us, pre_ms, post_ms;
+static int energy_fd = -1, temp_fd = -1;
+
+static uint64_t *ring;
+static int stride, ring_len;
+static uint64_t head;		/* records taken so far */
+static int span, lookback;	/* in records */
+static int shape_changed;
+
+static uint64_t burst_late, nr_dumps;
+
+static int parse_trigger(char *s, struct trigger *t)
+{
+	snprintf(t->desc, sizeof(t->desc), "%s", s);
+	t->armed = 1;
+	if (!strcmp(s, "shape")) {
+		t->type = TRIG_SHAPE;
+		return 1;
+	}
+	if (sscanf(s, "power>%lf", &t->value) == 1) {
+		t->type = TRIG_POWER;
+		return t->value > 0;
+	}
+	if (sscanf(s, "temp+%lf", &t->value) == 1) {
+		t->type = TRIG_TEMP;
+		return t->value > 0;
+	}
+	if (sscanf(s, "freq-%lf", &t->value) == 1) {
+		t->type = TRIG_FREQ;
+		return t->value > 0;
+	}
+	return 0;
+}
+
+int initialize_burst(struct config *cfg)
+{
+	char path[MAX_LEN];
+	int i;
+
+	if (!cfg->burst_us)
+		return 1;
+	if (!cfg->nr_triggers) {
+		printf("--burst needs at least one --trigger\n");
+		return 0;
+	}
+	if (!perf_stats[0].dev_msr_supported) {
+		printf("--burst needs /dev/cpu/*/msr\n");
+		return 0;
+	}
+	for (i = 0; i < cfg->nr_triggers; i++) {
+		if (!parse_trigger(cfg->trigger[i], &triggers[i])) {
+			printf("--trigger: shape, power>mW, temp+DegC or freq-MHz, not %s\n",
+					cfg->trigger[i]);
+			return 0;
+		}
+	}
+	nr_triggers = cfg->nr_triggers;
+	period_us = cfg->burst_us;
+	pre_ms = cfg->burst_pre_ms;
+	post_ms = cfg->burst_post_ms;
+
+	/* own fds: the sampling context seeks on the logger's */
+	if (!find_path(BASE_PATH_RAPL, "name", "package-0", "energy_uj", path))
+		energy_fd = open(path, O_RDONLY);
+	if (!find_path(BASE_PATH_TZONE, "type", "x86_pkg_temp", "temp", path))
+		temp_fd = open(path, O_RDONLY);
+
+	span = (TRIGGER_SPAN_US + period_us - 1) / period_us;
+	lookback = TRIGGER_LOOKBACK_MS * 1000 / period_us;
+	stride = REC_CPU + 3 * nr_threads;
+	ring_len = (pre_ms + post_ms) * 1000 / period_us + span + lookback + 2;
+	ring = calloc((size_t)ring_len * stride, sizeof(uint64_t));
+	if (!ring) {
+		perror("calloc burst ring");
+		return 0;
+	}
+	burst_enabled = 1;
+	return 1;
+}
+
+/* called whenever a worker mailbox is posted or a stepwise shape steps */
+void burst_note_shape(void)
+{
+	if (burst_enabled)
+		__atomic_store_n(&shape_changed, 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t *rec(uint64_t n)
+{
+	return ring + (n % ring_len) * stride;
+}
+
+static uint64_t read_sysfs(int fd)
+{
+	char buf[32];
+	int sz;
+
+	if (fd < 0)
+		return 0;
+	sz = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (sz <= 0)
+		return 0;
+	buf[sz] = '\0';
+	return strtoull(buf, NULL, 10);
+}
+
+static void take_record(uint64_t *r, struct timespec *now)
+{
+	int t;
+
+	r[REC_T] = (uint64_t)now->tv_sec * NSEC_PER_SEC + now->tv_nsec;
+	r[REC_ENERGY] = read_sysfs(energy_fd);
+	r[REC_TEMP] = read_sysfs(temp_fd);
+	for (t = 0; t < nr_threads; t++) {
+		read_msr(perf_stats[t].dev_msr_fd, MSR_IA32_APERF,
+						&r[REC_CPU + 3 * t]);
+		read_msr(perf_stats[t].dev_msr_fd, MSR_IA32_MPERF,
+						&r[REC_CPU + 3 * t + 1]);
+		read_msr(perf_stats[t].dev_msr_fd, MSR_IA32_TSC,
+						&r[REC_CPU + 3 * t + 2]);
+	}
+}
+
+/* between two records: package mW, mean C0 MHz and C0 % over all cpus */
+static void derive(uint64_t *a, uint64_t *b, double *mw, double *mhz,
+		   double *load)
+{
+	uint64_t da = 0, dm = 0, dt = 0;
+	double ns = b[REC_T] - a[REC_T];
+	int t;
+
+	for (t = 0; t < nr_threads; t++) {
+		da += b[REC_CPU + 3 * t] - a[REC_CPU + 3 * t];
+		dm += b[REC_CPU + 3 * t + 1] - a[REC_CPU + 3 * t + 1];
+		dt += b[REC_CPU + 3 * t + 2] - a[REC_CPU + 3 * t + 2];
+	}
+	/* energy_uj wraps at max_energy_range_uj: drop that interval */
+	*mw = (b[REC_ENERGY] >= a[REC_ENERGY] && ns > 0) ?
+		(double)(b[REC_ENERGY] - a[REC_ENERGY]) * 1000000 / ns : 0;
+	*mhz = dm ? (double)cpu_hfm_mhz * da / dm : 0;
+	*load = dt ? (double)dm * 100 / dt : 0;
+}
+
+static int trigger_cond(struct trigger *tr)
+{
+	double mw, mhz, load, then_mhz;
+
+	switch (tr->type) {
+	case TRIG_SHAPE:
+		return __atomic_exchange_n(&shape_changed, 0,
+						__ATOMIC_RELAXED);
+	case TRIG_POWER:
+		if (energy_fd < 0 || head <= (uint64_t)span)
+			return 0;
+		derive(rec(head - 1 - span), rec(head - 1), &mw, &mhz, &load);
+		return mw > tr->value;
+	case TRIG_TEMP:
+		if (temp_fd < 0 || head <= (uint64_t)lookback)
+			return 0;
+		return ((double)rec(head - 1)[REC_TEMP] -
+			(double)rec(head - 1 - lookback)[REC_TEMP]) / 1000 >=
+								tr->value;
+	case TRIG_FREQ:
+		if (head <= (uint64_t)(lookback + span))
+			return 0;
+		derive(rec(head - 1 - lookback - span),
+			rec(head - 1 - lookback), &mw, &then_mhz, &load);
+		derive(rec(head - 1 - span), rec(head - 1), &mw, &mhz, &load);
+		return then_mhz - mhz >= tr->value;
+	}
+	return 0;
+}
+
+static void dump(uint64_t trig, struct trigger *tr)
+{
+	char path[MAX_LEN + 16], text[MAX_MARK_LEN];
+	uint64_t n, first, *r, t0;
+	double mw, mhz, load, trig_ms;
+	FILE *fp;
+	int t;
+
+	t0 = rec(trig)[REC_T];
+	first = head > (uint64_t)ring_len - 1 ? head - (ring_len - 1) : 0;
+	while (first < trig && t0 - rec(first)[REC_T] >
+				(uint64_t)pre_ms * 1000000)
+		first++;
+	if (!first)
+		first = 1;
+
+	snprintf(path, sizeof(path), "%s.burst-%03llu",
+			configpv.log_file_name, (unsigned long long)nr_dumps);
+	fp = fopen(path, "w");
+	if (!fp) {
+		perror("burst file");
+		return;
+	}
+	trig_ms = ((double)t0 - ((double)first_tm.tv_sec * NSEC_PER_SEC +
+						first_tm.tv_nsec)) / 1000000;
+	fprintf(fp, "# trigger %s at Time %.3f ms, %d us period\n",
+			tr->desc, trig_ms, period_us);
+	fprintf(fp, "time_us, pkg_mw, freq_mhz, load_pct, temp_mc, energy_uj");
+	for (t = 0; t < nr_threads; t++)
+		fprintf(fp, ", aperf%d, mperf%d, tsc%d", perf_stats[t].cpu,
+				perf_stats[t].cpu, perf_stats[t].cpu);
+	fprintf(fp, "\n");
+
+	for (n = first; n < head; n++) {
+		r = rec(n);
+		derive(rec(n - 1), r, &mw, &mhz, &load);
+		fprintf(fp, "%.1f, %.1f, %.1f, %.2f, %llu, %llu",
+				((double)r[REC_T] - t0) / 1000, mw, mhz, load,
+				(unsigned long long)r[REC_TEMP],
+				(unsigned long long)r[REC_ENERGY]);
+		for (t = 0; t < nr_threads; t++)
+			fprintf(fp, ", %llu, %llu, %llu",
+				(unsigned long long)r[REC_CPU + 3 * t],
+				(unsigned long long)r[REC_CPU + 3 * t + 1],
+				(unsigned long long)r[REC_CPU + 3 * t + 2]);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+
+	/* file is <log-file>.burst-<nr> */
+	snprintf(text, sizeof(text), "burst %03llu: %s at %.3f",
+			(unsigned long long)nr_dumps, tr->desc, trig_ms);
+	control_mark(text);
+	nr_dumps++;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		perror("clock_gettime");
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void burst_fn(void *arg)
+{
+	int ret, i, cond;
+	uint64_t trig = 0, cpu_then, cpu_now;
+	struct trigger *fired = NULL;
+	struct timespec next, now;
+	char text[MAX_MARK_LEN];
+	sigset_t maskset;
+
+	UNUSED(arg);
+	sigfillset(&maskset);
+	ret = pthread_sigmask(SIG_BLOCK, &maskset, NULL);
+	if (ret)
+		printf("Couldn't mask signals in burst_fn. err:%d\n", ret);
+
+	if (configpv.sampler_cpu >= 0)
+		set_affinity(configpv.sampler_cpu);
+	set_sched_priority(1);
+
+	cpu_then = thread_cpu_ns();
+	if (clock_gettime(CLOCK_MONOTONIC, &next))
+		perror("clock_gettime");
+
+	while (!exit_cpu_thread) {
+		do {
+			ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+								&next, NULL);
+		} while (ret == EINTR && !exit_cpu_thread);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &now))
+			perror("clock_gettime");
+		take_record(rec(head), &now);
+		head++;
+
+		/* edge detection keeps running while a window fills */
+		for (i = 0; i < nr_triggers; i++) {
+			cond = trigger_cond(&triggers[i]);
+			if (cond && triggers[i].armed && !fired &&
+					nr_dumps < BURST_MAX_DUMPS) {
+				fired = &triggers[i];
+				trig = head - 1;
+				snprintf(text, sizeof(text), "trigger %s",
+							fired->desc);
+				control_mark(text);
+			}
+			triggers[i].armed = !cond;
+		}
+
+		if (fired && rec(head - 1)[REC_T] - rec(trig)[REC_T] >=
+					(uint64_t)post_ms * 1000000) {
+			dump(trig, fired);
+			fired = NULL;
+		}
+
+		if (configpv.sampler_cpu >= 0) {
+			cpu_now = thread_cpu_ns();
+			__atomic_add_fetch(&sampler_cpu_ns, cpu_now - cpu_then,
+							__ATOMIC_RELAXED);
+			cpu_then = cpu_now;
+		}
+
+		timespec_add_ns(&next, (uint64_t)period_us * 1000);
+		if (clock_gettime(CLOCK_MONOTONIC, &now))
+			perror("clock_gettime");
+		while (ts_compare(&next, &now) <= 0) {
+			timespec_add_ns(&next, (uint64_t)period_us * 1000);
+			burst_late++;
+		}
+	}
+	pthread_exit(NULL);
+}
+
+void burst_report(void)
+{
+	if (!burst_enabled)
+		return;
+	printf("Burst capture: %llu records every %d us, %llu late, %llu dumps\n",
+			(unsigned long long)head, period_us,
+			(unsigned long long)burst_late,
+			(unsigned long long)nr_dumps);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _BURST_H_
+#define _BURST_H_
+#include "parse_config.h"
+
+#define BURST_MIN_US (50)
+#define BURST_DEFAULT_WINDOW_MS (50)
+#define BURST_MAX_DUMPS (64)
+
+extern int initialize_burst(struct config *cfg);
+extern void burst_fn(void *arg);
+extern void burst_note_shape(void);
+extern void burst_report(void);
+#endif
@@ -0,0 +1,498 @@
+/*
+ * control.c: retune a running psst over a unix socket (--control)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "control.h"
+#include "logger.h"
+#include "burst.h"
+#include "perf_msr.h"
+
+#define CONTROL_ACCEPT_POLL_MS (200)
+#define CONTROL_LINE_LEN (512)
+#define MAX_MARKS (256)
+#define DUTY_EVENT_MIN (0.01)
+
+/*
+ * Protocol: one command per line, one reply line per command, "ok ..."
+ * or "err <reason>". Clients are served one at a time and may keep the
+ * connection open for any number of commands.
+ *
+ *	shape <shape-func,args> [cpu]	new shape for all stressed cpus or one
+ *	duty <percent> [cpu]		shorthand for shape single-step,<percent>
+ *	remove <cpu>			stop loading cpu (still monitored)
+ *	add <cpu>			load cpu again, with its last shape
+ *	poll <ms>			new poll period
+ *	mark <text>			"#mark" line in the log, see below
+ *	status				poll period and per cpu request
+ *	stop				end the run as ^C does
+ *
+ * Only cpus that got a worker at start (--cpumask, default all online)
+ * can be added back. Worker changes go to a per worker mailbox and are
+ * picked up by the worker at its next tick. Poll period and marks go
+ * through the sampling context at its next sample.
+ *
+ * Marks from here and from the scenario, sweep, step and burst engines
+ * (and --events duty cycle changes) are logged as
+ *	#mark, <Time>, <CLOCK_MONOTONIC_RAW ns>, <TSC>, <text>
+ * with both clocks read back to back when the mark is made, so they line
+ * up with perf and ftrace captures of the same run. --events trace also
+ * writes each one to tracefs trace_marker right away.
+ */
+static int listen_fd = -1;
+static data_t *workers;
+static int nr_workers;
+static pthread_mutex_t ctl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char shape_spec[CONTROL_LINE_LEN];
+
+static int pending_poll_ms;
+struct mark {
+	double time_ms;
+	uint64_t raw_ns, tsc;
+	char text[MAX_MARK_LEN];
+};
+static struct mark marks[MAX_MARKS];
+static int nr_marks;
+static uint64_t marks_dropped;
+static int trace_fd = -1;
+
+static const char *trace_marker_paths[] = {
+	"/sys/kernel/tracing/trace_marker",
+	"/sys/kernel/debug/tracing/trace_marker",
+};
+
+int initialize_events(struct config *cfg)
+{
+	unsigned int i;
+
+	if (cfg->events != EVENTS_TRACE)
+		return 1;
+	for (i = 0; i < sizeof(trace_marker_paths) /
+				sizeof(trace_marker_paths[0]); i++) {
+		trace_fd = open(trace_marker_paths[i], O_WRONLY | O_CLOEXEC);
+		if (trace_fd != -1)
+			return 1;
+	}
+	perror("--events trace: trace_marker");
+	return 0;
+}
+
+/* mailboxes are set up by main() before the workers start */
+void control_attach(data_t *w, int n)
+{
+	workers = w;
+	nr_workers = n;
+}
+
+/*
+ * Called by a worker once per tick. Cheap unless something changed:
+ * then the new shape restarts from now.
+ */
+int control_pick_up(data_t *d, unsigned int *seen, ps_t *ps, int *parked)
+{
+	if (__atomic_load_n(&d->ctl_gen, __ATOMIC_ACQUIRE) == *seen)
+		return 0;
+
+	pthread_mutex_lock(&ctl_mutex);
+	ps->psn = d->ctl_psn;
+	ps->psa = d->ctl_psa;
+	*parked = d->ctl_parked;
+	*seen = d->ctl_gen;
+	pthread_mutex_unlock(&ctl_mutex);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ps->last))
+		perror("clock_gettime");
+	ps->begin = ps->last;
+	return 1;
+}
+
+/* caller holds ctl_mutex */
+static void post(data_t *d)
+{
+	__atomic_add_fetch(&d->ctl_gen, 1, __ATOMIC_RELEASE);
+	burst_note_shape();
+}
+
+static data_t *find_worker(int cpu)
+{
+	int i;
+
+	for (i = 0; i < nr_workers; i++) {
+		if (workers[i].affinity_pr == cpu)
+			return &workers[i];
+	}
+	return NULL;
+}
+
+/*
+ * Marks are stamped on arrival and logged by the next sample. TSC is
+ * read through the first cpu's msr device; it is synchronized across
+ * cpus. 0 if the queue is full or there is no msr device.
+ */
+int control_mark(char *text)
+{
+	struct timespec now, raw;
+	struct mark m;
+	char line[MAX_MARK_LEN + 64];
+	int ret = 0, sz;
+
+	m.tsc = 0;
+	if (clock_gettime(CLOCK_MONOTONIC_RAW, &raw))
+		perror("clock_gettime");
+	if (perf_stats && perf_stats[0].dev_msr_supported)
+		read_msr(perf_stats[0].dev_msr_fd, MSR_IA32_TSC, &m.tsc);
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		perror("clock_gettime");
+
+	m.raw_ns = (uint64_t)raw.tv_sec * NSEC_PER_SEC + raw.tv_nsec;
+	m.time_ms = ts_compare(&now, &first_tm) <= 0 ?
+			0 : (double)diff_ns(&first_tm, &now) / 1000000;
+	snprintf(m.text, MAX_MARK_LEN, "%s", text);
+
+	if (trace_fd != -1) {
+		sz = snprintf(line, sizeof(line),
+			      "psst: %s mono_raw_ns=%llu tsc=%llu\n", m.text,
+			      (unsigned long long)m.raw_ns,
+			      (unsigned long long)m.tsc);
+		if (write(trace_fd, line, sz) != sz)
+			dbg_print("trace_marker write failed\n");
+	}
+
+	pthread_mutex_lock(&ctl_mutex);
+	if (nr_marks < MAX_MARKS) {
+		marks[nr_marks++] = m;
+		ret = 1;
+	} else {
+		marks_dropped++;
+	}
+	pthread_mutex_unlock(&ctl_mutex);
+	return ret;
+}
+
+/*
+ * --events: a worker's duty cycle moved by DUTY_EVENT_MIN or more since
+ * its last event. Ramps and sine waves step every 50 ms, so this is meant
+ * for short runs or stepwise shapes.
+ */
+void control_event_duty(int cpu, float *logged, float duty)
+{
+	char text[MAX_MARK_LEN];
+
+	if (configpv.events == EVENTS_OFF || fabsf(duty - *logged) <
+							DUTY_EVENT_MIN)
+		return;
+	snprintf(text, sizeof(text), "duty cpu%d: %.2f -> %.2f", cpu,
+							*logged, duty);
+	control_mark(text);
+	*logged = duty;
+}
+
+/* sampling context, before the sample's own record is logged */
+void control_sample(void)
+{
+	static struct mark out[MAX_MARKS];
+	int i, n, sz, ms;
+	char line[MAX_MARK_LEN + 96];
+
+	ms = __atomic_exchange_n(&pending_poll_ms, 0, __ATOMIC_ACQUIRE);
+	if (ms)
+		set_poll_period(ms);
+
+	if (!__atomic_load_n(&nr_marks, __ATOMIC_RELAXED))
+		return;
+
+	/* workers mark too: don't hold them up while the log is written */
+	pthread_mutex_lock(&ctl_mutex);
+	n = nr_marks;
+	memcpy(out, marks, n * sizeof(struct mark));
+	nr_marks = 0;
+	pthread_mutex_unlock(&ctl_mutex);
+
+	for (i = 0; i < n; i++) {
+		sz = snprintf(line, sizeof(line), "#mark, %.0f, %llu, %llu, %s\n",
+				out[i].time_ms,
+				(unsigned long long)out[i].raw_ns,
+				(unsigned long long)out[i].tsc, out[i].text);
+		if (configpv.verbose)
+			printf("%s", line);
+		if (!configpv.no_raw)
+			accumulate_flush_record(line, sz + 1, out[i].time_ms);
+	}
+}
+
+/* also used by the scenario engine. 0 if cpu has no worker */
+int control_set_shape(int cpu, data_t *shape)
+{
+	data_t *d = find_worker(cpu);
+
+	if (!d)
+		return 0;
+	pthread_mutex_lock(&ctl_mutex);
+	d->ctl_psn = shape->psn;
+	d->ctl_psa = shape->psa;
+	post(d);
+	pthread_mutex_unlock(&ctl_mutex);
+	return 1;
+}
+
+static int cmd_shape(char *spec, char *cpu_arg, char *reply, int len)
+{
+	int i, cpu = -1;
+	data_t tmp, *d;
+
+	memset(&tmp, 0, sizeof(tmp));
+	if (!parse_power_shape(spec, &tmp))
+		return snprintf(reply, len, "err bad shape %s\n", spec);
+
+	if (cpu_arg) {
+		cpu = atoi(cpu_arg);
+		if (!find_worker(cpu))
+			return snprintf(reply, len, "err no worker on cpu%d\n",
+									cpu);
+	}
+
+	pthread_mutex_lock(&ctl_mutex);
+	for (i = 0; i < nr_workers; i++) {
+		d = &workers[i];
+		if (cpu >= 0 ? d->affinity_pr != cpu :
+				(d->affinity_pr == 0 && dont_stress_cpu0))
+			continue;
+		d->ctl_psn = tmp.psn;
+		d->ctl_psa = tmp.psa;
+		post(d);
+	}
+	if (cpu < 0)
+		snprintf(shape_spec, sizeof(shape_spec), "%s", spec);
+	pthread_mutex_unlock(&ctl_mutex);
+	return snprintf(reply, len, "ok\n");
+}
+
+static int cmd_park(char *cpu_arg, int parked, char *reply, int len)
+{
+	int cpu;
+	data_t *d;
+
+	if (!cpu_arg)
+		return snprintf(reply, len, "err missing cpu\n");
+	cpu = atoi(cpu_arg);
+	d = find_worker(cpu);
+	if (!d)
+		return snprintf(reply, len, "err no worker on cpu%d\n", cpu);
+	if (parked && cpu == 0 && configpv.sampler_cpu < 0)
+		return snprintf(reply, len,
+			"err cpu0 samples inline. start with --sampler-cpu\n");
+
+	pthread_mutex_lock(&ctl_mutex);
+	d->ctl_parked = parked;
+	post(d);
+	pthread_mutex_unlock(&ctl_mutex);
+	return snprintf(reply, len, "ok\n");
+}
+
+static int cmd_status(char *reply, int len)
+{
+	int i, off;
+
+	off = snprintf(reply, len, "ok poll=%d shape=%s", configpv.poll_period,
+					shape_spec);
+	pthread_mutex_lock(&ctl_mutex);
+	for (i = 0; i < nr_workers && off < len; i++) {
+		if (workers[i].ctl_parked)
+			off += snprintf(reply + off, len - off, " cpu%d=parked",
+						workers[i].affinity_pr);
+		else
+			off += snprintf(reply + off, len - off, " cpu%d=%.2f",
+						workers[i].affinity_pr,
+						workers[i].duty_cycle);
+	}
+	pthread_mutex_unlock(&ctl_mutex);
+	if (off >= len - 1)
+		off = len - 2;
+	reply[off++] = '\n';
+	reply[off] = '\0';
+	return off;
+}
+
+static int run_command(char *line, char *reply, int len)
+{
+	int ms;
+	char *cmd, *arg1, *arg2, *save;
+	char spec[CONTROL_LINE_LEN];
+
+	cmd = strtok_r(line, " \t", &save);
+	if (!cmd)
+		return 0;
+
+	if (!strcmp(cmd, "mark")) {
+		arg1 = strtok_r(NULL, "", &save);
+		if (!control_mark(arg1 ? arg1 : ""))
+			return snprintf(reply, len, "err too many marks\n");
+		return snprintf(reply, len, "ok\n");
+	}
+
+	arg1 = strtok_r(NULL, " \t", &save);
+	arg2 = strtok_r(NULL, " \t", &save);
+
+	if (!strcmp(cmd, "shape") && arg1)
+		return cmd_shape(arg1, arg2, reply, len);
+	if (!strcmp(cmd, "duty") && arg1) {
+		snprintf(spec, sizeof(spec), "single-step,%s", arg1);
+		return cmd_shape(spec, arg2, reply, len);
+	}
+	if (!strcmp(cmd, "remove"))
+		return cmd_park(arg1, 1, reply, len);
+	if (!strcmp(cmd, "add"))
+		return cmd_park(arg1, 0, reply, len);
+	if (!strcmp(cmd, "poll") && arg1) {
+		ms = atoi(arg1);
+		if (ms <= 0)
+			return snprintf(reply, len, "err bad poll %s\n", arg1);
+		__atomic_store_n(&pending_poll_ms, ms, __ATOMIC_RELEASE);
+		return snprintf(reply, len, "ok\n");
+	}
+	if (!strcmp(cmd, "status"))
+		return cmd_status(reply, len);
+	if (!strcmp(cmd, "stop")) {
+		exit_cpu_thread = 1;
+		return snprintf(reply, len, "ok\n");
+	}
+	return snprintf(reply, len, "err unknown command %s\n", cmd);
+}
+
+static void serve_client(int fd, char *reply, int reply_len)
+{
+	int sz, have = 0;
+	char buf[CONTROL_LINE_LEN], *nl, *line;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	while (!exit_cpu_thread) {
+		if (poll(&pfd, 1, CONTROL_ACCEPT_POLL_MS) <= 0)
+			continue;
+		sz = recv(fd, buf + have, sizeof(buf) - 1 - have, 0);
+		if (sz <= 0)
+			return;
+		have += sz;
+		buf[have] = '\0';
+
+		line = buf;
+		while ((nl = strchr(line, '\n'))) {
+			*nl = '\0';
+			if (nl > line && nl[-1] == '\r')
+				nl[-1] = '\0';
+			sz = run_command(line, reply, reply_len);
+			if (sz > 0 && send(fd, reply, sz, MSG_NOSIGNAL) <= 0)
+				return;
+			line = nl + 1;
+		}
+		have -= line - buf;
+		memmove(buf, line, have);
+		if (have == sizeof(buf) - 1) {
+			/* no newline in a full buffer: drop it */
+			have = 0;
+		}
+	}
+}
+
+void control_serve(void *arg)
+{
+	int fd, ret, reply_len;
+	char *reply;
+	sigset_t sigmask;
+	struct pollfd pfd;
+
+	UNUSED(arg);
+	sigfillset(&sigmask);
+	ret = pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+	if (ret)
+		printf("control_serve: couldn't mask signals. err:%d\n", ret);
+
+	/* "status" is the longest reply: one entry per cpu */
+	reply_len = CONTROL_LINE_LEN + nr_workers * 24;
+	reply = malloc(reply_len);
+	if (!reply) {
+		perror("malloc control reply");
+		pthread_exit(NULL);
+	}
+
+	pfd.fd = listen_fd;
+	pfd.events = POLLIN;
+	while (!exit_cpu_thread) {
+		if (poll(&pfd, 1, CONTROL_ACCEPT_POLL_MS) <= 0)
+			continue;
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1)
+			continue;
+		serve_client(fd, reply, reply_len);
+		close(fd);
+	}
+	free(reply);
+	pthread_exit(NULL);
+}
+
+int initialize_control(struct config *cfg)
+{
+	struct sockaddr_un sun;
+
+	if (!cfg->control_path[0])
+		return 1;
+
+	snprintf(shape_spec, sizeof(shape_spec), "%s", cfg->shape_func);
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd == -1) {
+		perror("control socket");
+		return 0;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, cfg->control_path, sizeof(sun.sun_path) - 1);
+	unlink(sun.sun_path);
+	if (bind(listen_fd, (struct sockaddr *)&sun, sizeof(sun)) ||
+	    listen(listen_fd, 4)) {
+		perror("control bind");
+		close(listen_fd);
+		listen_fd = -1;
+		return 0;
+	}
+	return 1;
+}
+
+void finish_control(struct config *cfg)
+{
+	if (marks_dropped)
+		printf("%llu marks dropped, more than %d between samples\n",
+				(unsigned long long)marks_dropped, MAX_MARKS);
+	if (trace_fd != -1) {
+		close(trace_fd);
+		trace_fd = -1;
+	}
+	if (listen_fd == -1)
+		return;
+
+	close(listen_fd);
+	listen_fd = -1;
+	unlink(cfg->control_path);
+}
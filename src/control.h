@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+#include "parse_config.h"
+
+#define MAX_MARK_LEN 128
+
+extern int initialize_control(struct config *cfg);
+extern int initialize_events(struct config *cfg);
+extern void control_event_duty(int cpu, float *logged, float duty);
+extern void control_attach(data_t *workers, int n);
+extern void control_serve(void *);
+extern int control_pick_up(data_t *d, unsigned int *seen, ps_t *ps,
+			   int *parked);
+extern int control_mark(char *text);
+extern int control_set_shape(int cpu, data_t *shape);
+extern void control_sample(void);
+extern void finish_control(struct config *cfg);
+#endif
@@ -0,0 +1,498 @@
+/*
+ * derive.c: per sample metrics computed from other columns (--derive)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "derive.h"
+#include "logger.h"
+#include "perf_msr.h"
+
+/*
+ * --derive name=expr, in the order given, each compiled once into a
+ * stack machine program and run every sample after the columns:
+ *	expr	+ - * / unary -, ( ), numbers
+ *	Name	a logged column (pwrPkg0, Qperf, ..) or an earlier --derive
+ *	dt	interval of the sample [ms]
+ *	load(N) freq(N) scale(N) nperf(N)	per cpu metric of cpu N
+ *	aperf(N) mperf(N) pperf(N) tsc(N)	per cpu counter diff of cpu N
+ *	avg(expr, n)	mean of expr over the last n samples
+ * Evaluation does not allocate; avg() windows are set up at compile time.
+ * x/0 gives inf or nan as IEEE says; non finite values stay out of avg().
+ */
+enum op {
+	OP_CONST, OP_COL, OP_DERIVED, OP_DT, OP_CPU,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_AVG,
+};
+
+enum cpu_field {
+	CF_LOAD, CF_FREQ, CF_SCALE, CF_NPERF,
+	CF_APERF, CF_MPERF, CF_PPERF, CF_TSC, NR_CF,
+};
+
+static const char *cpu_field_name[NR_CF] = {
+	"load", "freq", "scale", "nperf", "aperf", "mperf", "pperf", "tsc",
+};
+
+struct insn {
+	enum op op;
+	int arg;	/* column, derived#, thread# or avg# */
+	int field;	/* OP_CPU */
+	double k;	/* OP_CONST */
+};
+
+struct avg {
+	double *ring;
+	int n, head, count;
+	double sum;
+};
+
+struct derived {
+	char name[DERIVE_NAME_LEN];
+	struct insn code[DERIVE_MAX_INSNS];
+	int nr_insns;
+	double value;
+	int width;
+};
+
+int nr_derived;
+static struct derived *dv;
+static struct avg *avgs;
+static int nr_avgs;
+static double sample_dt;
+
+/* compile state */
+static const char *pos, *tok;	/* tok: start of the current value */
+static struct derived *cur;
+static int depth, max_depth, nr_avg_slots;
+
+static int compile_error(const char *msg)
+{
+	printf("--derive %s: %s at '%s'\n", cur->name, msg, tok);
+	return 0;
+}
+
+static void skip_space(void)
+{
+	while (isspace((unsigned char)*pos))
+		pos++;
+}
+
+static int emit(enum op op, int arg, int field, double k)
+{
+	struct insn *in;
+
+	if (cur->nr_insns == DERIVE_MAX_INSNS)
+		return compile_error("expression too long");
+	in = &cur->code[cur->nr_insns++];
+	in->op = op;
+	in->arg = arg;
+	in->field = field;
+	in->k = k;
+	/* operands push one, binary operators pop one net */
+	if (op <= OP_CPU)
+		depth++;
+	else if (op <= OP_DIV)
+		depth--;
+	if (depth > max_depth)
+		max_depth = depth;
+	return 1;
+}
+
+static int parse_expr(void);
+
+static int cpu_to_thread(int cpu)
+{
+	int t;
+
+	for (t = 0; t < nr_threads; t++) {
+		if (perf_stats[t].cpu == cpu)
+			return t;
+	}
+	return -1;
+}
+
+static int parse_call(char *name)
+{
+	int f, t, n;
+	char *end;
+
+	pos++;	/* ( */
+	if (!strcmp(name, "avg")) {
+		if (!parse_expr())
+			return 0;
+		skip_space();
+		if (*pos != ',')
+			return compile_error("expected ','");
+		pos++;
+		n = strtol(pos, &end, 10);
+		if (end == pos || n < 1 || n > DERIVE_MAX_AVG)
+			return compile_error("avg() window out of range");
+		pos = end;
+		skip_space();
+		if (*pos != ')')
+			return compile_error("expected ')'");
+		pos++;
+		if (!emit(OP_AVG, nr_avg_slots, n, 0))
+			return 0;
+		nr_avg_slots++;
+		return 1;
+	}
+	for (f = 0; f < NR_CF; f++) {
+		if (!strcmp(name, cpu_field_name[f]))
+			break;
+	}
+	if (f == NR_CF)
+		return compile_error("unknown function");
+	skip_space();
+	n = strtol(pos, &end, 10);
+	if (end == pos)
+		return compile_error("expected cpu number");
+	pos = end;
+	skip_space();
+	if (*pos != ')')
+		return compile_error("expected ')'");
+	pos++;
+	t = cpu_to_thread(n);
+	if (t < 0)
+		return compile_error("cpu not in --cpumask");
+	if (f >= CF_APERF && !perf_stats[0].dev_msr_supported)
+		return compile_error("counter diffs need MSRs");
+	return emit(OP_CPU, t, f, 0);
+}
+
+static int parse_primary(void)
+{
+	char name[32];
+	char *end;
+	double k;
+	int i, n = 0;
+
+	skip_space();
+	tok = pos;
+	if (*pos == '(') {
+		pos++;
+		if (!parse_expr())
+			return 0;
+		skip_space();
+		if (*pos != ')')
+			return compile_error("expected ')'");
+		pos++;
+		return 1;
+	}
+	if (isdigit((unsigned char)*pos) || *pos == '.') {
+		k = strtod(pos, &end);
+		if (end == pos)
+			return compile_error("bad number");
+		pos = end;
+		return emit(OP_CONST, 0, 0, k);
+	}
+	while ((isalnum((unsigned char)*pos) || *pos == '_') &&
+					n < (int)sizeof(name) - 1)
+		name[n++] = *pos++;
+	name[n] = '\0';
+	if (!n)
+		return compile_error("expected a value");
+
+	skip_space();
+	if (*pos == '(')
+		return parse_call(name);
+	if (!strcmp(name, "dt"))
+		return emit(OP_DT, 0, 0, 0);
+	for (i = 0; i < cur - dv; i++) {
+		if (!strcmp(name, dv[i].name))
+			return emit(OP_DERIVED, i, 0, 0);
+	}
+	i = find_column(name);
+	if (i < 0 || !col_desc[i].report_enabled)
+		return compile_error("no such column");
+	return emit(OP_COL, i, 0, 0);
+}
+
+static int parse_unary(void)
+{
+	skip_space();
+	if (*pos == '-') {
+		pos++;
+		return parse_unary() && emit(OP_NEG, 0, 0, 0);
+	}
+	return parse_primary();
+}
+
+static int parse_term(void)
+{
+	char c;
+
+	if (!parse_unary())
+		return 0;
+	for (;;) {
+		skip_space();
+		c = *pos;
+		if (c != '*' && c != '/')
+			return 1;
+		pos++;
+		if (!parse_unary() ||
+		    !emit(c == '*' ? OP_MUL : OP_DIV, 0, 0, 0))
+			return 0;
+	}
+}
+
+static int parse_expr(void)
+{
+	char c;
+
+	if (!parse_term())
+		return 0;
+	for (;;) {
+		skip_space();
+		c = *pos;
+		if (c != '+' && c != '-')
+			return 1;
+		pos++;
+		if (!parse_term() ||
+		    !emit(c == '+' ? OP_ADD : OP_SUB, 0, 0, 0))
+			return 0;
+	}
+}
+
+static int compile(struct derived *d, const char *def)
+{
+	const char *eq = strchr(def, '=');
+	int n = eq ? eq - def : 0, i;
+
+	if (n < 1 || n >= DERIVE_NAME_LEN) {
+		printf("--derive expects name=expr, name up to %d chars\n",
+						DERIVE_NAME_LEN - 1);
+		return 0;
+	}
+	memcpy(d->name, def, n);
+	d->name[n] = '\0';
+	for (i = 0; i < n; i++) {
+		if (!isalnum((unsigned char)d->name[i]) && d->name[i] != '_') {
+			printf("--derive %s: bad name\n", d->name);
+			return 0;
+		}
+	}
+	if (find_column(d->name) >= 0) {
+		printf("--derive %s: name of a column\n", d->name);
+		return 0;
+	}
+
+	cur = d;
+	tok = pos = eq + 1;
+	depth = max_depth = 0;
+	if (!parse_expr())
+		return 0;
+	skip_space();
+	if (*pos) {
+		tok = pos;
+		return compile_error("unexpected");
+	}
+	if (max_depth > DERIVE_STACK)
+		return compile_error("expression nests too deep");
+	d->width = n > 10 ? n : 10;
+	return 1;
+}
+
+int initialize_derive(struct config *cfg)
+{
+	int i, k, a = 0;
+
+	if (!cfg->nr_derive)
+		return 1;
+
+	dv = calloc(cfg->nr_derive, sizeof(struct derived));
+	if (!dv) {
+		perror("calloc derive");
+		return 0;
+	}
+	nr_avg_slots = 0;
+	for (k = 0; k < cfg->nr_derive; k++) {
+		if (!compile(&dv[k], cfg->derive[k]))
+			return 0;
+	}
+
+	nr_avgs = nr_avg_slots;
+	avgs = calloc(nr_avgs ? nr_avgs : 1, sizeof(struct avg));
+	if (!avgs) {
+		perror("calloc derive avg");
+		return 0;
+	}
+	for (k = 0; k < cfg->nr_derive; k++) {
+		for (i = 0; i < dv[k].nr_insns; i++) {
+			if (dv[k].code[i].op != OP_AVG)
+				continue;
+			avgs[a].n = dv[k].code[i].field;
+			avgs[a].ring = calloc(avgs[a].n, sizeof(double));
+			if (!avgs[a].ring) {
+				perror("calloc derive avg");
+				return 0;
+			}
+			a++;
+		}
+	}
+	nr_derived = cfg->nr_derive;
+	return 1;
+}
+
+static double cpu_value(int t, int field)
+{
+	switch (field) {
+	case CF_LOAD:
+		return perf_diffs.load[t];
+	case CF_FREQ:
+		return perf_diffs.freq[t];
+	case CF_SCALE:
+		return perf_diffs.scale[t];
+	case CF_NPERF:
+		return perf_diffs.nperf[t];
+	case CF_APERF:
+		return perf_diffs.aperf[t];
+	case CF_MPERF:
+		return perf_diffs.mperf[t];
+	case CF_PPERF:
+		return perf_diffs.pperf[t];
+	default:
+		return perf_diffs.tsc[t];
+	}
+}
+
+static double avg_push(struct avg *a, double x)
+{
+	if (isfinite(x)) {
+		if (a->count == a->n)
+			a->sum -= a->ring[a->head];
+		else
+			a->count++;
+		a->ring[a->head] = x;
+		a->sum += x;
+		a->head = (a->head + 1) % a->n;
+	}
+	return a->count ? a->sum / a->count : NAN;
+}
+
+static double run(struct derived *d)
+{
+	double st[DERIVE_STACK];
+	struct insn *in;
+	int sp = 0, i;
+
+	for (i = 0; i < d->nr_insns; i++) {
+		in = &d->code[i];
+		switch (in->op) {
+		case OP_CONST:
+			st[sp++] = in->k;
+			break;
+		case OP_COL:
+			st[sp++] = col_desc[in->arg].value;
+			break;
+		case OP_DERIVED:
+			st[sp++] = dv[in->arg].value;
+			break;
+		case OP_DT:
+			st[sp++] = sample_dt;
+			break;
+		case OP_CPU:
+			st[sp++] = cpu_value(in->arg, in->field);
+			break;
+		case OP_ADD:
+			sp--;
+			st[sp - 1] += st[sp];
+			break;
+		case OP_SUB:
+			sp--;
+			st[sp - 1] -= st[sp];
+			break;
+		case OP_MUL:
+			sp--;
+			st[sp - 1] *= st[sp];
+			break;
+		case OP_DIV:
+			sp--;
+			st[sp - 1] /= st[sp];
+			break;
+		case OP_NEG:
+			st[sp - 1] = -st[sp - 1];
+			break;
+		case OP_AVG:
+			st[sp - 1] = avg_push(&avgs[in->arg], st[sp - 1]);
+			break;
+		}
+	}
+	return st[0];
+}
+
+/* sampling context, once the columns of a record are final */
+void derive_sample(double interval_ms)
+{
+	int k;
+
+	sample_dt = interval_ms;
+	for (k = 0; k < nr_derived; k++)
+		dv[k].value = run(&dv[k]);
+}
+
+const char *derive_name(int k)
+{
+	return dv[k].name;
+}
+
+double derive_value(int k)
+{
+	return dv[k].value;
+}
+
+/* log record bytes the columns may take */
+int derive_width(void)
+{
+	return nr_derived * 48;
+}
+
+/* header (row 0: names, 1: units) or values, like os_stats_print() */
+int derive_print(char *buf, int row, const char *delim)
+{
+	int sz = 0, k, n;
+
+	for (k = 0; k < nr_derived; k++) {
+		if (row == 0)
+			sz += sprintf(buf + sz, "%*s%s", dv[k].width,
+						dv[k].name, delim);
+		else if (row == 1)
+			sz += sprintf(buf + sz, "%*s%s", dv[k].width, "[=]",
+								delim);
+		else {
+			n = snprintf(buf + sz, 48, "%*.3f%s", dv[k].width,
+						dv[k].value, delim);
+			sz += n < 48 ? n : 47;
+		}
+	}
+	return sz;
+}
+
+void finish_derive(void)
+{
+	int a;
+
+	for (a = 0; a < nr_avgs; a++)
+		free(avgs[a].ring);
+	free(avgs);
+	free(dv);
+	nr_derived = nr_avgs = 0;
+}
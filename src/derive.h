@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _DERIVE_H_
+#define _DERIVE_H_
+#include "parse_config.h"
+
+#define DERIVE_NAME_LEN (16)
+#define DERIVE_MAX_INSNS (64)
+#define DERIVE_STACK (16)
+#define DERIVE_MAX_AVG (4096)
+
+extern int nr_derived;
+extern int initialize_derive(struct config *cfg);
+extern void derive_sample(double interval_ms);
+extern const char *derive_name(int k);
+extern double derive_value(int k);
+extern int derive_width(void);
+extern int derive_print(char *buf, int row, const char *delim);
+extern void finish_derive(void);
+#endif
@@ -0,0 +1,362 @@
+/*
+ * fallback.c: load, frequency & steal without MSRs (VMs, containers)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "fallback.h"
+#include "os_stats.h"
+#include "perf_msr.h"
+
+/*
+ * Without /dev/cpu/N/msr, perf_diffs.load and .freq of every cpu come
+ * from what the OS exposes and feed the Load, Freq and MaxCPU columns (and
+ * metrics, summary, ..) as the MSR derived values would:
+ *	load	running time from /proc/schedstat (ns) over the interval, else
+ *		non idle, non steal ticks of /proc/stat
+ *	freq	cpufreq scaling_cur_freq, else on x86 a chain of dependent
+ *		adds (one per cycle) timed on the sampling cpu and taken for
+ *		all cpus; no frequency on other archs
+ * ScaleF and Qperf need PPERF and stay off. Steal is the % of the
+ * interval the hypervisor ran something else on the selected cpus, logged
+ * without MSRs and whenever the cpu flags say "hypervisor".
+ */
+#define PROC_STAT "/proc/stat"
+#define PROC_SCHEDSTAT "/proc/schedstat"
+/* first size of the /proc read buffer; grows to fit large machines */
+#define PROC_READ_BUF (64 * 1024)
+#define SPIN_ADDS (64)
+#define SPIN_LOOPS (256)
+#define SPIN_RUNS (3)
+
+/* /proc/stat cpu line fields */
+enum { ST_USER, ST_NICE, ST_SYSTEM, ST_IDLE, ST_IOWAIT, ST_IRQ, ST_SOFTIRQ,
+       ST_STEAL, NR_ST };
+
+/* st_ok, run_ok: st, run_ns hold a reading to diff against */
+struct fb_cpu {
+	uint64_t st[NR_ST];
+	uint64_t run_ns;
+	int st_ok, run_ok;
+	int cur_fd;
+};
+
+int perf_fallback;
+static int steal_enabled;
+static int stat_fd = -1, schedstat_fd = -1;
+static int freq_spin;
+static struct fb_cpu *fb;
+static char *proc_buf;
+static size_t proc_buf_sz;
+static struct timespec fb_last_tm;
+static int fb_first = 1;
+
+static int is_hypervisor_guest(void)
+{
+	char line[4096];
+	FILE *fp;
+	int found = 0;
+
+	fp = fopen("/proc/cpuinfo", "r");
+	if (!fp)
+		return 0;
+	while (!found && fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "flags", 5))
+			found = strstr(line, " hypervisor") ? 1 : -1;
+	}
+	fclose(fp);
+	return found > 0;
+}
+
+/* thread# of cpu, -1 if not selected */
+static int cpu_to_thread(int cpu)
+{
+	int t;
+
+	for (t = 0; t < nr_threads; t++) {
+		if (perf_stats[t].cpu == cpu)
+			return t;
+	}
+	return -1;
+}
+
+/* whole file into proc_buf, to EOF: one cpu per line can exceed 64K */
+static int read_proc(int fd)
+{
+	size_t sz = 0;
+	ssize_t rd;
+	char *p;
+
+	for (;;) {
+		if (proc_buf_sz - sz < 2) {
+			p = realloc(proc_buf, proc_buf_sz * 2);
+			if (!p) {
+				perror("realloc fallback");
+				break;
+			}
+			proc_buf = p;
+			proc_buf_sz *= 2;
+		}
+		rd = pread(fd, proc_buf + sz, proc_buf_sz - sz - 1, sz);
+		if (rd <= 0)
+			break;
+		sz += rd;
+	}
+	if (!sz)
+		return 0;
+	proc_buf[sz] = '\0';
+	return sz;
+}
+
+/* per cpu tick counters into st[][], found[] set. returns cpus found */
+static int parse_stat(uint64_t (*st)[NR_ST], char *found)
+{
+	char *line, *save;
+	unsigned long long v[NR_ST];
+	int cpu, t, n = 0, k;
+
+	if (!read_proc(stat_fd))
+		return 0;
+	for (line = strtok_r(proc_buf, "\n", &save); line;
+				line = strtok_r(NULL, "\n", &save)) {
+		if (strncmp(line, "cpu", 3))
+			break;
+		memset(v, 0, sizeof(v));
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+			   &v[6], &v[7]) < 5)
+			continue;
+		t = cpu_to_thread(cpu);
+		if (t < 0)
+			continue;
+		for (k = 0; k < NR_ST; k++)
+			st[t][k] = v[k];
+		found[t] = 1;
+		n++;
+	}
+	return n;
+}
+
+/* "cpuN yld 0 sched goidle ttwu ttwu_local rq_cpu_time ..." */
+static int parse_schedstat(uint64_t *run_ns, char *found)
+{
+	char *line, *save;
+	unsigned long long v[7];
+	int cpu, t, n = 0;
+
+	if (!read_proc(schedstat_fd))
+		return 0;
+	for (line = strtok_r(proc_buf, "\n", &save); line;
+				line = strtok_r(NULL, "\n", &save)) {
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+			   &v[6]) != 8)
+			continue;
+		t = cpu_to_thread(cpu);
+		if (t < 0)
+			continue;
+		run_ns[t] = v[6];
+		found[t] = 1;
+		n++;
+	}
+	return n;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * MHz of this cpu: cycles of an add chain per us, best of SPIN_RUNS.
+ * register, not immediate, adds: recent cores fold add-immediate chains.
+ */
+static float spin_mhz(void)
+{
+	struct timespec t0, t1;
+	uint64_t x = 0, y = 1, ns, best = ~0ULL;
+	int r, i;
+
+	for (r = 0; r < SPIN_RUNS; r++) {
+		if (clock_gettime(CLOCK_MONOTONIC_RAW, &t0))
+			return 0;
+		for (i = 0; i < SPIN_LOOPS; i++)
+			__asm__ volatile(".rept 64\n\tadd %1, %0\n\t.endr"
+							: "+r"(x) : "r"(y));
+		if (clock_gettime(CLOCK_MONOTONIC_RAW, &t1))
+			return 0;
+		ns = diff_ns(&t0, &t1);
+		if (ns && ns < best)
+			best = ns;
+	}
+	return best == ~0ULL ? 0 :
+		(float)SPIN_LOOPS * SPIN_ADDS * 1000 / best;
+}
+#else
+static float spin_mhz(void)
+{
+	return 0;
+}
+#endif
+
+int initialize_fallback(struct config *cfg, int msr_ok)
+{
+	char path[MAX_LEN];
+	int t;
+
+	UNUSED(cfg);
+	steal_enabled = !msr_ok || is_hypervisor_guest();
+	col_desc[STEAL_TIME].report_enabled = steal_enabled;
+	if (msr_ok && !steal_enabled)
+		return 1;
+
+	fb = calloc(nr_threads, sizeof(struct fb_cpu));
+	proc_buf = malloc(PROC_READ_BUF);
+	if (!fb || !proc_buf) {
+		perror("malloc fallback");
+		return 0;
+	}
+	proc_buf_sz = PROC_READ_BUF;
+	stat_fd = open(PROC_STAT, O_RDONLY | O_CLOEXEC);
+	if (stat_fd == -1) {
+		perror(PROC_STAT);
+		col_desc[STEAL_TIME].report_enabled = steal_enabled = 0;
+		if (msr_ok)
+			return 1;
+	}
+	if (msr_ok)
+		return 1;
+
+	schedstat_fd = open(PROC_SCHEDSTAT, O_RDONLY | O_CLOEXEC);
+	if (stat_fd == -1 && schedstat_fd == -1) {
+		printf("no MSRs, %s or %s: no load\n", PROC_STAT,
+							PROC_SCHEDSTAT);
+		return 0;
+	}
+
+	for (t = 0; t < nr_threads; t++) {
+		snprintf(path, sizeof(path), "%s%s/cpu%d/cpufreq/scaling_cur_freq",
+			configpv.hw_root, SYSFS_CPU_PATH, perf_stats[t].cpu);
+		fb[t].cur_fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	if (fb[0].cur_fd == -1) {
+		freq_spin = spin_mhz() > 0;
+		if (!freq_spin)
+			col_desc[FREQ_REALIZED].report_enabled = 0;
+	}
+	col_desc[SCALE_FACTOR].report_enabled = 0;
+	col_desc[NORM_PERF].report_enabled = 0;
+
+	printf("No MSRs: load from %s, frequency from %s\n",
+		schedstat_fd != -1 ? PROC_SCHEDSTAT : PROC_STAT,
+		fb[0].cur_fd != -1 ? "scaling_cur_freq" :
+		freq_spin ? "a timed add chain" : "nowhere");
+	perf_fallback = 1;
+	return 1;
+}
+
+/*
+ * Sampling context, before the per cpu diffs are used. Fills
+ * perf_diffs.load/.freq without MSRs, and Steal.
+ */
+void fallback_sample(struct timespec *tm)
+{
+	uint64_t st[nr_threads][NR_ST], run_ns[nr_threads];
+	uint64_t total, dtotal = 0, dsteal = 0, d[NR_ST];
+	char st_found[nr_threads], run_found[nr_threads];
+	double interval_ns;
+	char buf[32];
+	float mhz = 0;
+	int t, k, have_run = 0;
+
+	if (!perf_fallback && !steal_enabled)
+		return;
+
+	interval_ns = fb_first ? 0 : (double)diff_ns(&fb_last_tm, tm);
+	fb_last_tm = *tm;
+
+	/* cpus missing from a read keep their last reading, and no diff */
+	memset(st, 0, sizeof(st));
+	memset(run_ns, 0, sizeof(run_ns));
+	memset(st_found, 0, sizeof(st_found));
+	memset(run_found, 0, sizeof(run_found));
+	if (stat_fd != -1)
+		parse_stat(st, st_found);
+	if (perf_fallback && schedstat_fd != -1)
+		have_run = parse_schedstat(run_ns, run_found);
+	if (freq_spin)
+		mhz = spin_mhz();
+
+	for (t = 0; t < nr_threads; t++) {
+		total = 0;
+		memset(d, 0, sizeof(d));
+		if (st_found[t] && fb[t].st_ok) {
+			for (k = 0; k < NR_ST; k++) {
+				d[k] = st[t][k] - fb[t].st[k];
+				total += d[k];
+			}
+			dtotal += total;
+			dsteal += d[ST_STEAL];
+		}
+		if (perf_fallback) {
+			if (fb_first)
+				perf_diffs.load[t] = 0;
+			else if (have_run)
+				perf_diffs.load[t] = run_found[t] &&
+					fb[t].run_ok && interval_ns > 0 ?
+					(run_ns[t] - fb[t].run_ns) * 100 /
+							interval_ns : 0;
+			else
+				perf_diffs.load[t] = total ? (float)(total -
+					d[ST_IDLE] - d[ST_IOWAIT] -
+					d[ST_STEAL]) * 100 / total : 0;
+			if (fb[t].cur_fd != -1 &&
+			    pread(fb[t].cur_fd, buf, sizeof(buf) - 1, 0) > 0)
+				perf_diffs.freq[t] = atoi(buf) / 1000.0;
+			else
+				perf_diffs.freq[t] = mhz;
+			perf_diffs.scale[t] = perf_diffs.nperf[t] = 0;
+		}
+		if (run_found[t]) {
+			fb[t].run_ns = run_ns[t];
+			fb[t].run_ok = 1;
+		}
+		if (st_found[t]) {
+			memcpy(fb[t].st, st[t], sizeof(fb[t].st));
+			fb[t].st_ok = 1;
+		}
+	}
+	if (steal_enabled)
+		col_desc[STEAL_TIME].value = dtotal ?
+				(double)dsteal * 100 / dtotal : 0;
+	fb_first = 0;
+}
+
+void finish_fallback(void)
+{
+	int t;
+
+	if (stat_fd != -1)
+		close(stat_fd);
+	if (schedstat_fd != -1)
+		close(schedstat_fd);
+	for (t = 0; perf_fallback && t < nr_threads; t++) {
+		if (fb[t].cur_fd != -1)
+			close(fb[t].cur_fd);
+	}
+	stat_fd = schedstat_fd = -1;
+	perf_fallback = steal_enabled = 0;
+}
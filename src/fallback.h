@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _FALLBACK_H_
+#define _FALLBACK_H_
+#include <time.h>
+#include "parse_config.h"
+
+/* perf_diffs.load/.freq come from fallback_sample(), not MSRs */
+extern int perf_fallback;
+
+extern int initialize_fallback(struct config *cfg, int msr_ok);
+extern void fallback_sample(struct timespec *tm);
+extern void finish_fallback(void);
+#endif
@@ -0,0 +1,268 @@
+/*
+ * idle_skip.c: leave idle cpus asleep instead of reading their MSRs
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include "idle_skip.h"
+#include "os_stats.h"
+#include "perf_msr.h"
+
+/*
+ * Every /dev/cpu/N/msr read of another cpu is an IPI that pulls a sleeping
+ * core out of its C-state, which is the very power an idle study measures.
+ * With --idle-skip a cpu is not read in a sample when, since its last read:
+ *	- it was read and below IDLE_SKIP_LOAD % C0,
+ *	- its cpuidle usage counters show no new idle entry (one is allowed
+ *	  after a read: our own IPI puts it back to sleep once), so it never
+ *	  woke up and went back to sleep,
+ *	- /proc/stat gives it no busy ticks, so it did not wake up and stay
+ *	  running either (nohz accounts the idle time of a sleeping cpu live),
+ *	- it was skipped fewer than IDLE_SKIP_MAX samples in a row.
+ * The sampling cpu is always read, that costs no IPI. A skipped cpu keeps
+ * its previous freq and scale, load & perf are 0 (mperf did not move) and
+ * its counter diffs stay 0; the next real read covers the whole time since
+ * the last one. Skip logs the number of cpus skipped in a sample.
+ */
+#define PROC_STAT "/proc/stat"
+/* first size of the /proc/stat buffer; grows to fit large machines */
+#define STAT_READ_BUF (64 * 1024)
+
+struct skip_cpu {
+	int usage_fd[MAX_IDLE_STATES];
+	int nr_states;
+	uint64_t usage, busy;
+	int skipped;		/* samples in a row */
+	float freq, scale;	/* of the last read */
+};
+
+static int skip_enabled;
+static int skip_first = 1;
+static struct skip_cpu *sc;
+static char *skip_now;
+static int stat_fd = -1;
+static char *stat_buf;
+static size_t stat_buf_sz;
+static uint64_t nr_reads, nr_skips;
+
+static uint64_t pread_u64(int fd)
+{
+	char buf[32];
+	int sz;
+
+	sz = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (sz <= 0)
+		return 0;
+	buf[sz] = '\0';
+	return strtoull(buf, NULL, 10);
+}
+
+/* all of /proc/stat into stat_buf: one cpu per line can exceed 64K */
+static int read_stat(void)
+{
+	size_t sz = 0;
+	ssize_t rd;
+	char *p;
+
+	for (;;) {
+		if (stat_buf_sz - sz < 2) {
+			p = realloc(stat_buf, stat_buf_sz * 2);
+			if (!p) {
+				perror("realloc idle_skip");
+				break;
+			}
+			stat_buf = p;
+			stat_buf_sz *= 2;
+		}
+		rd = pread(stat_fd, stat_buf + sz, stat_buf_sz - sz - 1, sz);
+		if (rd <= 0)
+			break;
+		sz += rd;
+	}
+	if (!sz)
+		return 0;
+	stat_buf[sz] = '\0';
+	return sz;
+}
+
+/*
+ * busy (user, nice, system, irq, softirq) ticks of the selected cpus,
+ * found[] set for those in the file
+ */
+static int read_busy(uint64_t *busy, char *found)
+{
+	unsigned long long v[7];
+	char *line, *save;
+	int cpu, t, n = 0;
+
+	if (!read_stat())
+		return 0;
+	for (line = strtok_r(stat_buf, "\n", &save); line;
+				line = strtok_r(NULL, "\n", &save)) {
+		if (strncmp(line, "cpu", 3))
+			break;
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+			   &v[6]) != 8)
+			continue;
+		for (t = 0; t < nr_threads; t++) {
+			if (perf_stats[t].cpu != cpu)
+				continue;
+			busy[t] = v[0] + v[1] + v[2] + v[5] + v[6];
+			found[t] = 1;
+			n++;
+			break;
+		}
+	}
+	return n;
+}
+
+int initialize_idle_skip(struct config *cfg)
+{
+	char path[MAX_LEN];
+	int t, s, fd, have_idle = 0;
+
+	if (!cfg->idle_skip)
+		return 1;
+	if (!perf_stats[0].dev_msr_supported) {
+		printf("--idle-skip: no MSRs read, nothing to skip\n");
+		return 1;
+	}
+
+	sc = calloc(nr_threads, sizeof(struct skip_cpu));
+	skip_now = calloc(nr_threads, 1);
+	stat_buf = malloc(STAT_READ_BUF);
+	if (!sc || !skip_now || !stat_buf) {
+		perror("malloc idle_skip");
+		return 0;
+	}
+	stat_buf_sz = STAT_READ_BUF;
+	stat_fd = open(PROC_STAT, O_RDONLY | O_CLOEXEC);
+	if (stat_fd == -1) {
+		perror(PROC_STAT);
+		return 0;
+	}
+	for (t = 0; t < nr_threads; t++) {
+		for (s = 0; s < MAX_IDLE_STATES; s++) {
+			snprintf(path, sizeof(path),
+				"%s%s/cpu%d/cpuidle/state%d/usage",
+				configpv.hw_root, SYSFS_CPU_PATH,
+				perf_stats[t].cpu, s);
+			fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (fd == -1)
+				break;
+			sc[t].usage_fd[s] = fd;
+		}
+		sc[t].nr_states = s;
+		have_idle |= s > 0;
+	}
+	if (!have_idle) {
+		printf("--idle-skip: no cpuidle usage in %s\n", SYSFS_CPU_PATH);
+		return 0;
+	}
+	col_desc[IDLE_SKIPPED].report_enabled = 1;
+	skip_enabled = 1;
+	return 1;
+}
+
+/* sampling context, before the MSRs are read: pick the cpus to leave be */
+void idle_skip_sample(void)
+{
+	uint64_t busy[nr_threads], usage;
+	char found[nr_threads];
+	int t, s, self, have_busy, n = 0;
+
+	if (!skip_enabled)
+		return;
+
+	memset(busy, 0, sizeof(busy));
+	memset(found, 0, sizeof(found));
+	have_busy = read_busy(busy, found);
+	self = sched_getcpu();
+	for (t = 0; t < nr_threads; t++) {
+		struct skip_cpu *c = &sc[t];
+
+		usage = 0;
+		for (s = 0; s < c->nr_states; s++)
+			usage += pread_u64(c->usage_fd[s]);
+
+		/* a cpu missing from /proc/stat is read: nothing says it slept */
+		skip_now[t] = !skip_first && c->nr_states && have_busy &&
+			found[t] &&
+			perf_stats[t].cpu != self &&
+			(perf_diffs.tsc[t] || c->skipped) &&
+			perf_diffs.load[t] < IDLE_SKIP_LOAD &&
+			usage - c->usage <= (uint64_t)(c->skipped ? 0 : 1) &&
+			busy[t] == c->busy &&
+			c->skipped < IDLE_SKIP_MAX;
+
+		c->skipped = skip_now[t] ? c->skipped + 1 : 0;
+		c->usage = usage;
+		c->busy = busy[t];
+		n += skip_now[t];
+	}
+	nr_reads += nr_threads;
+	nr_skips += n;
+	col_desc[IDLE_SKIPPED].value = n;
+	skip_first = 0;
+}
+
+int idle_skipped(int t)
+{
+	return skip_enabled && skip_now[t];
+}
+
+/* after compute_perf_diffs(): skipped cpus keep freq & scale of last read */
+void idle_skip_carry(void)
+{
+	int t;
+
+	if (!skip_enabled)
+		return;
+	for (t = 0; t < nr_threads; t++) {
+		if (skip_now[t]) {
+			perf_diffs.freq[t] = sc[t].freq;
+			perf_diffs.scale[t] = sc[t].scale;
+		} else {
+			sc[t].freq = perf_diffs.freq[t];
+			sc[t].scale = perf_diffs.scale[t];
+		}
+	}
+}
+
+void finish_idle_skip(void)
+{
+	int t, s;
+
+	if (!skip_enabled)
+		return;
+	printf("idle skip: %llu of %llu cpu reads skipped\n",
+		(unsigned long long)nr_skips, (unsigned long long)nr_reads);
+	for (t = 0; t < nr_threads; t++) {
+		for (s = 0; s < sc[t].nr_states; s++)
+			close(sc[t].usage_fd[s]);
+	}
+	close(stat_fd);
+	free(sc);
+	free(skip_now);
+	free(stat_buf);
+	skip_enabled = 0;
+}
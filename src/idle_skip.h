@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _IDLE_SKIP_H_
+#define _IDLE_SKIP_H_
+#include "parse_config.h"
+
+/* C0 % of the last read below which a cpu may be skipped */
+#define IDLE_SKIP_LOAD (1.0)
+/* samples in a row a cpu may be skipped before it is read anyway */
+#define IDLE_SKIP_MAX (10)
+
+extern int initialize_idle_skip(struct config *cfg);
+extern void idle_skip_sample(void);
+extern int idle_skipped(int t);
+extern void idle_skip_carry(void);
+extern void finish_idle_skip(void);
+#endif
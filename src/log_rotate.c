@@ -0,0 +1,202 @@
+/*
+ * log_rotate.c: roll the log over to numbered segments by size or time
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "log_rotate.h"
+#include "logger.h"
+
+/*
+ * Segments are only ever touched by the io thread (page_write_disk), so
+ * nothing here is locked. Rotation happens on page boundaries: a segment
+ * may overshoot --rotate-time by at most one page worth of samples.
+ */
+struct segment {
+	unsigned int num;
+	double start_ms;
+	double end_ms;
+	long long bytes;
+};
+
+static struct segment *seg;	/* retained segments, oldest first */
+static int nr_seg, max_seg;
+static unsigned int next_seg_num;
+
+int log_rotate_enabled(struct config *cfg)
+{
+	return cfg->rotate_size || cfg->rotate_time;
+}
+
+static int open_segment(struct config *cfg)
+{
+	int fd;
+	char name[MAX_LEN];
+	struct segment *tmp;
+
+	if (nr_seg == max_seg) {
+		tmp = realloc(seg, sizeof(struct segment) * (max_seg + 64));
+		if (!tmp) {
+			perror("realloc segment table");
+			return -1;
+		}
+		seg = tmp;
+		max_seg += 64;
+	}
+
+	snprintf(name, sizeof(name), SEGMENT_NAME_FMT,
+				cfg->log_file_name, next_seg_num);
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+	if (fd == -1) {
+		perror("log segment");
+		return -1;
+	}
+	seg[nr_seg].num = next_seg_num++;
+	seg[nr_seg].start_ms = -1;
+	seg[nr_seg].end_ms = -1;
+	seg[nr_seg].bytes = 0;
+	nr_seg++;
+	dbg_print("opened log segment %s\n", name);
+	return fd;
+}
+
+/* drop the oldest segments beyond --rotate-keep */
+static void expire_segments(struct config *cfg)
+{
+	int i, n;
+	char name[MAX_LEN];
+
+	if (!cfg->rotate_keep || nr_seg <= cfg->rotate_keep)
+		return;
+
+	n = nr_seg - cfg->rotate_keep;
+	for (i = 0; i < n; i++) {
+		snprintf(name, sizeof(name), SEGMENT_NAME_FMT,
+					cfg->log_file_name, seg[i].num);
+		if (unlink(name))
+			perror("unlink log segment");
+	}
+	for (i = 0; i < cfg->rotate_keep; i++)
+		seg[i] = seg[i + n];
+	nr_seg = cfg->rotate_keep;
+}
+
+/*
+ * index is rewritten as a whole and renamed in place, so a reader never
+ * sees a partial file. rows are in time order; binary search on start_ms.
+ */
+static void write_index(struct config *cfg)
+{
+	int i;
+	FILE *fp;
+	char name[MAX_LEN], tmp_name[MAX_LEN + 8];
+
+	snprintf(name, sizeof(name), SEGMENT_INDEX_FMT, cfg->log_file_name);
+	snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name);
+	fp = fopen(tmp_name, "w");
+	if (!fp) {
+		perror("log index");
+		return;
+	}
+	fprintf(fp, "#segment, start_ms, end_ms, bytes, file\n");
+	for (i = 0; i < nr_seg; i++) {
+		fprintf(fp, "%u, %.0f, %.0f, %lld, " SEGMENT_NAME_FMT "\n",
+				seg[i].num, seg[i].start_ms, seg[i].end_ms,
+				seg[i].bytes, cfg->log_file_name, seg[i].num);
+	}
+	fclose(fp);
+	if (rename(tmp_name, name))
+		perror("log index rename");
+}
+
+static void update_segment_bytes(struct config *cfg)
+{
+	off_t pos;
+
+	pos = lseek(cfg->log_file_fd, 0, SEEK_CUR);
+	if (pos >= 0)
+		seg[nr_seg - 1].bytes = pos;
+}
+
+int initialize_log_rotate(struct config *cfg)
+{
+	cfg->log_file_fd = open_segment(cfg);
+	if (cfg->log_file_fd == -1)
+		return 0;
+	write_index(cfg);
+	return 1;
+}
+
+/*
+ * Called by the io thread just before a page holding samples
+ * [first_ms, last_ms] of sz bytes is written out. Switches
+ * cfg->log_file_fd to a fresh segment (with header) if the page would
+ * push the current segment past its size or time budget.
+ */
+void log_rotate_page(struct config *cfg, int sz,
+		     double first_ms, double last_ms)
+{
+	int fd, wr_sz;
+	struct segment *cur;
+
+	if (!log_rotate_enabled(cfg) || !nr_seg)
+		return;
+
+	update_segment_bytes(cfg);
+	cur = &seg[nr_seg - 1];
+
+	if (cur->start_ms >= 0 &&
+	    ((cfg->rotate_size && cur->bytes + sz > cfg->rotate_size) ||
+	     (cfg->rotate_time &&
+	      first_ms - cur->start_ms >= cfg->rotate_time * 1000.0))) {
+		fd = open_segment(cfg);
+		if (fd == -1) {
+			/* keep appending to the current segment */
+			printf("**log rotate failed. continuing in segment %u**\n",
+								cur->num);
+		} else {
+			close(cfg->log_file_fd);
+			cfg->log_file_fd = fd;
+			if (log_header) {
+				wr_sz = write(fd, log_header, log_header_sz);
+				if (wr_sz == -1)
+					perror("segment header write");
+			}
+			expire_segments(cfg);
+			write_index(cfg);
+		}
+		cur = &seg[nr_seg - 1];
+	}
+
+	if (cur->start_ms < 0)
+		cur->start_ms = first_ms;
+	cur->end_ms = last_ms;
+}
+
+void log_rotate_finish(struct config *cfg)
+{
+	if (!log_rotate_enabled(cfg) || !nr_seg)
+		return;
+
+	update_segment_bytes(cfg);
+	write_index(cfg);
+}
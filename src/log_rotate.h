@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _LOG_ROTATE_H_
+#define _LOG_ROTATE_H_
+#include "parse_config.h"
+
+/* segment N of log file "name" is "name.NNNNN". index is "name.idx" */
+#define SEGMENT_NAME_FMT "%s.%05u"
+#define SEGMENT_INDEX_FMT "%s.idx"
+
+extern int log_rotate_enabled(struct config *cfg);
+extern int initialize_log_rotate(struct config *cfg);
+extern void log_rotate_page(struct config *cfg, int sz,
+			    double first_ms, double last_ms);
+extern void log_rotate_finish(struct config *cfg);
+#endif
@@ -31,6 +31,23 @@
 #include "rapl.h"
 #include "perf_msr.h"
 #include "parse_config.h"
+#include "log_rotate.h"
+#include "shm_export.h"
+#include "metrics.h"
+#include "rollup.h"
+#include "summary.h"
+#include "selfstat.h"
+#include "control.h"
+#include "scenario.h"
+#include "sweep.h"
+#include "step.h"
+#include "trace_freq.h"
+#include "os_stats.h"
+#include "fallback.h"
+#include "idle_skip.h"
+#include "adaptive.h"
+#include "derive.h"
+#include "work.h"
 #ifdef _LINUX_
 #include <time.h>
 #elif defined _ANDROID_
@@ -80,6 +97,27 @@ struct log_col_desc col_desc[] = {
 	INIT_COL(1, CpuDts, [DegC], 6.2, 0.001, NORMAL_FD, 0),
 	/* SOC_DTS: cpu die temp  */
 	INIT_COL(1, SocDts, [DegC], 6.2, 0.001, NORMAL_FD, 0),
+	/* SELF_*: psst's own timing, only with --self-stats */
+	INIT_COL(1, Jitter, [us], 8.1, 1, NO_FD, 0),
+	INIT_COL(1, LogCost, [us], 8.1, 1, NO_FD, 0),
+	INIT_COL(1, PerfCost, [us], 8.1, 1, NO_FD, 0),
+	INIT_COL(1, FlushCost, [us], 9.1, 1, NO_FD, 0),
+	INIT_COL(1, IoLat, [us], 8.1, 1, NO_FD, 0),
+	/* PHASE_ID: --scenario phase of the interval, 0 before the plan */
+	INIT_COL(1, Phase, [#], 6.0, 1, NO_FD, 0),
+	/* TRACE_*: from power tracepoints, only with --trace-freq */
+	INIT_COL(1, TrFreq, [MHz], 8.2, 1, NO_FD, 0),
+	INIT_COL(1, TrIdle, [%], 7.2, 1, NO_FD, 0),
+	/* STEAL_TIME: hypervisor steal of the selected cpus, see fallback.c */
+	INIT_COL(0, Steal, [%], 6.2, 1, NO_FD, 0),
+	/* IDLE_SKIPPED: cpus not read in the sample, see idle_skip.c */
+	INIT_COL(0, Skip, [#], 5.0, 1, NO_FD, 0),
+	/* POLL_PERIOD: interval of the sample, see adaptive.c */
+	INIT_COL(0, Poll, [ms], 7.2, 1, NO_FD, 0),
+	/* OPS_*: work of the workers, only with --ops, see work.c */
+	INIT_COL(0, Ops, [Mop/s], 8.3, 1, NO_FD, 0),
+	INIT_COL(0, OpsJ, [Mop/J], 8.3, 1, NO_FD, 0),
+	INIT_COL(0, OpsJCore, [Mop/J], 8.3, 1, NO_FD, 0),
 };
 
 int complete_path(char *path, char *compl)
@@ -138,7 +176,7 @@ int get_node_name(char *base, char *node, char *result)
 	FILE *fp;
 	char path[MAX_LEN];
 
-	sprintf(path, "cat %s/%s 2>/dev/null", base, node);
+	sprintf(path, "cat %s%s/%s 2>/dev/null", configpv.hw_root, base, node);
 	fp = popen(path, "r");
 	if (!fp) {
 		perror("get_node_name()");
@@ -167,7 +205,8 @@ int find_path(char *base, char *node, char *match, char *replace, char *buf)
 	char list[2048] = {0};
 	char *token, *loc;
 
-	sprintf(path, "find %s* -name %s 2>/dev/null", base, node);
+	sprintf(path, "find %s%s* -name %s 2>/dev/null", configpv.hw_root,
+								base, node);
 	fp = popen(path, "r");
 	if (!fp) {
 		perror("find_path()");
@@ -224,6 +263,9 @@ static char *page[2];
 static char *active_pg;
 static char *dirty_pg;
 static int active_pg_filled, dirty_pg_filled;
+/* time stamp range [ms] of the records held in each page */
+static double active_first_ms, active_last_ms;
+static double dirty_first_ms, dirty_last_ms;
 static int io_inprogress;
 
 static pthread_mutex_t pmutex = PTHREAD_MUTEX_INITIALIZER;
@@ -245,7 +287,10 @@ void trigger_disk_io(void)
 	pthread_mutex_unlock(&pmutex);
 }
 
-void accumulate_flush_record(char *record, int sz)
+/* record bytes put in the pages so far, header excluded */
+uint64_t log_record_bytes;
+
+void accumulate_flush_record(char *record, int sz, double ts_ms)
 {
 	char *temp_pg;
 	if ((PAGE_SIZE_BYTES - active_pg_filled < sz) || exit_cpu_thread)
@@ -257,9 +302,13 @@ void accumulate_flush_record(char *record, int sz)
 	 */
 	if (active_pg_filled != 0)
 		active_pg_filled -= 1;
+	else
+		active_first_ms = ts_ms;
 
 	memcpy(active_pg + active_pg_filled, record, sz);
 	active_pg_filled += sz;
+	log_record_bytes += sz - 1;
+	active_last_ms = ts_ms;
 
 	if (PAGE_SIZE_BYTES - active_pg_filled	<= sz) {
 		/*
@@ -273,6 +322,8 @@ void accumulate_flush_record(char *record, int sz)
 			temp_pg = dirty_pg;
 			dirty_pg = active_pg;
 			dirty_pg_filled = active_pg_filled;
+			dirty_first_ms = active_first_ms;
+			dirty_last_ms = active_last_ms;
 
 			active_pg = temp_pg;
 			active_pg_filled = 0;
@@ -302,6 +353,7 @@ void page_write_disk(void *confg)
 
 	do {
 		int wr_sz;
+		uint64_t t0;
 		UNUSED(wr_sz);
 		pthread_mutex_lock(&pmutex);
 		pthread_cond_wait(&pcond, &pmutex);
@@ -310,15 +362,23 @@ void page_write_disk(void *confg)
 		io_inprogress  = 1;
 		/* if we are exiting, just dump the active page */
 		if (!exit_cpu_thread) {
+			log_rotate_page(cfg, dirty_pg_filled - 1,
+					dirty_first_ms, dirty_last_ms);
+			t0 = selfstat_start();
 			wr_sz = write(cfg->log_file_fd, dirty_pg,
 							dirty_pg_filled - 1);
+			selfstat_end(SELF_IO, t0);
 			if (wr_sz == -1)
 				perror("fail dirty pg write");
 			dbg_print("wrote %d io page bytes to log.\n", wr_sz);
-		} else {
+		} else if (active_pg_filled) {
+			log_rotate_page(cfg, active_pg_filled - 1,
+					active_first_ms, active_last_ms);
 			/* reset to top of page */
+			t0 = selfstat_start();
 			wr_sz = write(cfg->log_file_fd, active_pg,
 							active_pg_filled - 1);
+			selfstat_end(SELF_IO, t0);
 
 			if (wr_sz == -1)
 				perror("fail active pg write");
@@ -329,6 +389,7 @@ void page_write_disk(void *confg)
 
 	} while (!exit_io_thread && !exit_cpu_thread);
 
+	log_rotate_finish(cfg);
 	pthread_cond_destroy(&pcond);
 	pthread_mutex_destroy(&pmutex);
 	pthread_exit(NULL);
@@ -348,8 +409,6 @@ void initialize_logger(void)
 		}
 
 		switch (i) {
-		case FREQ_REALIZED:
-		case LOAD_REALIZED:
 		case SCALE_FACTOR:
 		case NORM_PERF:
 		/* XXX: for gfx C0, create separate columns */
@@ -357,13 +416,38 @@ void initialize_logger(void)
 				col_desc[i].report_enabled = 0;
 			}
 			continue;  /* No file descriptor required */
+		case FREQ_REALIZED:
+		case LOAD_REALIZED:
 		case MAX_FREQ_CPU:
-			if (get_node_name("/dev/cpu/0", "msr", NULL) < 0)
-				col_desc[i].report_enabled = 0;
+			/* without msr, initialize_fallback() has the say */
 			continue;  /* No file descriptor required */
 		case TIME_STAMP_MS:
 		case LOAD_REQUEST:
 			continue;  /* No file descriptor required */
+		case SELF_JITTER_US:
+		case SELF_LOG_US:
+		case SELF_PERF_US:
+		case SELF_FLUSH_US:
+		case SELF_IO_US:
+			if (!configpv.self_stats)
+				col_desc[i].report_enabled = 0;
+			continue;  /* No file descriptor required */
+		case PHASE_ID:
+			if (!configpv.scenario_file[0])
+				col_desc[i].report_enabled = 0;
+			continue;  /* No file descriptor required */
+		case TRACE_FREQ:
+		case TRACE_IDLE:
+			if (!configpv.trace_freq)
+				col_desc[i].report_enabled = 0;
+			continue;  /* No file descriptor required */
+		case STEAL_TIME:
+		case IDLE_SKIPPED:
+		case POLL_PERIOD:
+		case OPS_RATE:
+		case OPS_PER_J_PKG:
+		case OPS_PER_J_CORE:
+			continue;  /* No file descriptor required */
 		case PKG0_POWER_RAPL:
 			if (find_path(BASE_PATH_RAPL, "name", "package-0",
 							"energy_uj", path)) {
@@ -430,19 +514,77 @@ void initialize_logger(void)
 	return;
 }
 
-static char *log_header;
+int find_column(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (!strcmp(col_desc[i].header_name, name))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * --col-period: a sysfs column (power, limit, temperature) read only every
+ * period_ms, rounded up to whole poll periods. It logs its last value in
+ * between; power is averaged over the time since its own last read.
+ */
+int initialize_col_periods(struct config *cfg)
+{
+	int i, c, poll = cfg->poll_period;
+
+	for (i = 0; i < cfg->nr_col_periods; i++) {
+		c = find_column(cfg->period_col[i]);
+		if (c < 0 || col_desc[c].fd_type != NORMAL_FD) {
+			printf("--col-period: %s is not a sysfs column\n",
+							cfg->period_col[i]);
+			return 0;
+		}
+		if (!col_desc[c].report_enabled)
+			continue;
+		col_desc[c].period_ms = (cfg->period_ms[i] + poll - 1) /
+							poll * poll;
+	}
+	return 1;
+}
+
+char *log_header;
+int log_header_sz;
 
 struct timespec plog_last_tm, first_tm;
 int plog_poll_sec, plog_poll_nsec;
 int duration_sec, duration_nsec;
 
-void initialize_log_clock(void)
+/* Time column counts from epoch, the common start of all workers */
+void initialize_log_clock(struct timespec *epoch)
 {
-	struct timespec tm;
-	if (clock_gettime(CLOCK_MONOTONIC, &tm))
-		perror("clock_gettime");
-	first_tm.tv_sec = plog_last_tm.tv_sec = tm.tv_sec;
-	first_tm.tv_nsec = plog_last_tm.tv_nsec = tm.tv_nsec;
+	first_tm.tv_sec = plog_last_tm.tv_sec = epoch->tv_sec;
+	first_tm.tv_nsec = plog_last_tm.tv_nsec = epoch->tv_nsec;
+}
+
+/* sampling context only: takes effect from the next poll on */
+void set_poll_period(int ms)
+{
+	configpv.poll_period = ms;
+	plog_poll_sec = MSEC_TO_SEC(ms);
+	plog_poll_nsec = REMAINING_MS_TO_NS(ms);
+}
+
+/* by whichever context samples: cpu0 worker or the sampler thread */
+void initialize_sampling(struct timespec *epoch)
+{
+	float dummy;
+
+	set_poll_period(configpv.poll_period);
+
+	duration_sec = MSEC_TO_SEC(configpv.duration);
+	duration_nsec = (duration_sec > 0) ?
+			REMAINING_MS_TO_NS(configpv.duration) :
+			configpv.duration * 1000000;
+	dbg_print("sampling sec: %d nsec %d\n", duration_sec, duration_nsec);
+	initialize_log_clock(epoch);
+	update_perf_diffs(&dummy);
 }
 
 uint64_t diff_ns(struct timespec *ts_then, struct timespec *ts_now)
@@ -459,62 +601,36 @@ uint64_t diff_ns(struct timespec *ts_then, struct timespec *ts_now)
 
 int update_perf_diffs(float *sum_norm_perf)
 {
-	int fd, maxed_cpu_idx;
-	float max_load, next_max_load;
-	float _sum_nperf = 0, nperf = 0;
-	uint64_t aperf_raw, mperf_raw, pperf_raw, tsc_raw, poll_cpu_us;
-
-	for (int t = 0; t < nr_threads; t++) {
-		fd = perf_stats[t].dev_msr_fd;
-
-		/*
-		 * XXX: per-cpu IPI wakes for msr read will cost power. Need to
-		 * skip poll for idle bound cpus (e.g, using C-state count).
-		 * note: all-core sum perf considers per-respective poll time
-		 */
-		read_msr(fd, (uint32_t)MSR_IA32_PPERF, &pperf_raw);
-		read_msr(fd, (uint32_t)MSR_IA32_APERF, &aperf_raw);
-		read_msr(fd, (uint32_t)MSR_IA32_MPERF, &mperf_raw);
-		read_msr(fd, (uint32_t)MSR_IA32_TSC, &tsc_raw);
-
-		perf_stats[t].pperf_diff = cpu_get_diff_pperf(pperf_raw, t);
-		perf_stats[t].aperf_diff = cpu_get_diff_aperf(aperf_raw, t);
-		perf_stats[t].mperf_diff = cpu_get_diff_mperf(mperf_raw, t);
-		perf_stats[t].tsc_diff = cpu_get_diff_tsc(tsc_raw, t);
+	int t, maxed_cpu_idx;
+	float max_load;
 
-		poll_cpu_us = perf_stats[t].tsc_diff/cpu_hfm_mhz;
-
-		/*
-		 * Normalized perf metric defined as pperf per load per time.
-		 * The rationale is detailed in the followingi paper:
-		 * github.com/intel/psst >whitepapers >Generic_perf_per_watt.pdf
-		 * Given that delta_load = delta_mperf/delta_tsc, we can rewrite
-		 * as given below.
-		 */
-		if (perf_stats[t].mperf_diff) {
-			nperf = (float) perf_stats[t].pperf_diff/poll_cpu_us;
-			nperf = (float) nperf * perf_stats[t].tsc_diff;
-			nperf = (float) nperf/(perf_stats[t].mperf_diff);
-			perf_stats[t].nperf = (uint64_t)nperf;
-			_sum_nperf += (float) nperf;
+	/*
+	 * per-cpu IPI wakes for msr read cost power: with --idle-skip cpus
+	 * idle since their last read are left asleep, see idle_skip.c.
+	 * note: all-core sum perf considers per-respective poll time
+	 */
+	if (perf_fallback) {
+		/* perf_diffs already filled by fallback_sample() */
+		*sum_norm_perf = 0;
+	} else {
+		idle_skip_sample();
+		for (t = 0; t < nr_threads; t++) {
+			if (!idle_skipped(t))
+				read_perf_msrs(t, perf_stats[t].dev_msr_fd);
 		}
+		*sum_norm_perf = compute_perf_diffs(nr_threads);
+		idle_skip_carry();
 	}
-	*sum_norm_perf = _sum_nperf;
 
-	max_load = 100*(float)perf_stats[0].mperf_diff/perf_stats[0].tsc_diff;
+	max_load = perf_diffs.load[0];
 	maxed_cpu_idx = 0;
 
-	 for (int t = 1; t < nr_threads; t++) {
-		next_max_load = 100 * (float) perf_stats[t].mperf_diff /
-						perf_stats[t].tsc_diff;
-
+	for (t = 1; t < nr_threads; t++) {
 		/* float comparison with some meaningful difference */
-		if (max_load > (next_max_load + 0.01))
+		if (max_load > (perf_diffs.load[t] + 0.01))
 			continue;
-		else {
-			max_load = next_max_load;
-			maxed_cpu_idx = t;
-		}
+		max_load = perf_diffs.load[t];
+		maxed_cpu_idx = t;
 	}
 
 	return maxed_cpu_idx;
@@ -525,25 +641,18 @@ int update_perf_diffs(float *sum_norm_perf)
 int first_log = 1;
 uint64_t pp0_initial_energy, soc_initial_energy[4];
 uint64_t pp0_diff_uj, soc_diff_uj[4];
+/* sums of the per-sample deltas: monotonic across counter wraps */
+uint64_t pp0_total_uj, soc_total_uj[4];
 
 int rapl_pp0_supported;
 
+/*
+ * Called on every iteration of the cpu0 worker's ON loop. Takes a sample
+ * once per poll period and ends the run after duration.
+ */
 void do_logging(float dc)
 {
-	int log_header_sz = LOG_HEADER_SZ_MIN + nr_threads*PER_THREAD_SZ;
-	char buf[64];
-	char final_buf[log_header_sz];
-	char val_fmt[16];
-	char delim[] = ",    ";
-	char delim_short[] = ",  ";
-	log_col_t i;
-	int sz, sz1, pkg_num;
-	int max_cpu = 0;
-	int m = 0;
-	float sum_norm_perf = 0;
-	struct timespec tm;
-
-	*buf = '\0';
+	struct timespec tm, sched;
 
 	if (clock_gettime(CLOCK_MONOTONIC, &tm))
 		perror("clock_gettime");
@@ -558,25 +667,92 @@ void do_logging(float dc)
 					plog_poll_sec, plog_poll_nsec))
 		return;
 
-	plog_last_tm.tv_sec = tm.tv_sec;
-	plog_last_tm.tv_nsec = tm.tv_nsec;
+	if (!first_log) {
+		/* due one poll period after the previous sample */
+		sched.tv_sec = plog_last_tm.tv_sec + plog_poll_sec;
+		sched.tv_nsec = plog_last_tm.tv_nsec + plog_poll_nsec;
+		if (sched.tv_nsec >= NSEC_PER_SEC) {
+			sched.tv_sec++;
+			sched.tv_nsec -= NSEC_PER_SEC;
+		}
+		selfstat_jitter(&sched, &tm);
+	}
+	log_sample(dc, &tm);
+}
+
+/* due within half a poll: late samples must not push a read a tick out */
+static int col_due(struct log_col_desc *col, double now_ms)
+{
+	return !col->period_ms || first_log ||
+		now_ms - col->read_ms >= col->period_ms -
+					configpv.poll_period / 2.0;
+}
+
+/* poll every column & per-cpu counter now, tm being the time of the poll */
+/* records taken so far, whatever the poll period was at the time */
+unsigned long long log_samples;
+
+void log_sample(float dc, struct timespec *tm)
+{
+	int log_buf_sz = LOG_HEADER_SZ_MIN + nr_threads*PER_THREAD_SZ +
+			 os_stats_width() + work_width() + derive_width();
+	char buf[64];
+	char final_buf[log_buf_sz];
+	char val_fmt[16];
+	char delim[] = ",    ";
+	char delim_short[] = ",  ";
+	log_col_t i;
+	int sz, sz1, pkg_num, ediff;
+	int max_cpu = 0;
+	int m = 0;
+	float sum_norm_perf = 0;
+	float interval_ms, col_ms;
+	double now_ms;
+	uint64_t t_log, t0;
+
+	t_log = selfstat_start();
+	*buf = '\0';
+
+	/* poll period and marks from --control go in before this record */
+	control_sample();
+	log_samples++;
+
+	/* energy is per actual interval: samples can be late, poll can change */
+	interval_ms = first_log ? configpv.poll_period :
+			(float)diff_ns(&plog_last_tm, tm) / 1000000;
+	if (interval_ms <= 0)
+		interval_ms = configpv.poll_period;
+
+	plog_last_tm.tv_sec = tm->tv_sec;
+	plog_last_tm.tv_nsec = tm->tv_nsec;
+	now_ms = (double)diff_ns(&first_tm, tm) / 1000000;
 
 	/*
-	 * When dev_msr not supported, the diffs are not populated.
-	 * In these cases the associated columns have been disabled anyway.
+	 * When dev_msr not supported, fallback_sample() populates load and
+	 * freq of the diffs. Columns needing the rest have been disabled.
 	 */
-	if (perf_stats->dev_msr_supported) {
+	fallback_sample(tm);
+	if (perf_stats->dev_msr_supported || perf_fallback) {
+		t0 = selfstat_start();
 		m = update_perf_diffs(&sum_norm_perf);
+		selfstat_end(SELF_PERF, t0);
 		max_cpu = perf_stats[m].cpu;
 	}
+	trace_freq_sample(tm);
+	os_stats_sample(tm);
 
 	for (i = 0; i < MAX_COL_NUM; i++) {
 		if (!col_desc[i].report_enabled)
 				continue;
+		/* not due: keeps the value of its last read */
+		if (!col_due(&col_desc[i], now_ms))
+			continue;
+		col_ms = col_desc[i].period_ms && !first_log ?
+				now_ms - col_desc[i].read_ms : interval_ms;
+		col_desc[i].read_ms = now_ms;
 
 		if (col_desc[i].fd_type == NORMAL_FD) {
-			lseek(col_desc[i].poll_fd, 0L, SEEK_SET);
-			sz = read(col_desc[i].poll_fd, buf, 64);
+			sz = pread(col_desc[i].poll_fd, buf, 64, 0);
 			if (sz == -1) {
 				perror("read poll_fd 1");
 				printf(" col desc read fd err %d\n", i);
@@ -593,12 +769,10 @@ void do_logging(float dc)
 			break;
 		case LOAD_REALIZED:
 			/* real C0 = delta-mperf/delta-tsc */
-			col_desc[i].value = (float) perf_stats[m].mperf_diff *
-					      100/perf_stats[m].tsc_diff;
+			col_desc[i].value = perf_diffs.load[m];
 			break;
 		case SCALE_FACTOR:
-			col_desc[i].value = (float) perf_stats[m].pperf_diff *
-					      100/perf_stats[m].aperf_diff;
+			col_desc[i].value = perf_diffs.scale[m];
 			break;
 		case NORM_PERF:
 			col_desc[i].value = sum_norm_perf;
@@ -609,8 +783,7 @@ void do_logging(float dc)
 			break;
 		case FREQ_REALIZED:
 			/* real freq = TSC* delta-aperf/delta-mperf */
-			col_desc[i].value = (float) perf_stats[m].aperf_diff /
-					   perf_stats[m].mperf_diff*cpu_hfm_mhz;
+			col_desc[i].value = perf_diffs.freq[m];
 			break;
 		case PKG0_POWER_RAPL:
 			pkg_num = i - PKG0_POWER_RAPL;
@@ -619,8 +792,9 @@ void do_logging(float dc)
 
 			soc_diff_uj[pkg_num] = atoll(buf) - soc_initial_energy[pkg_num];
 
-			col_desc[i].value = (float) rapl_ediff_pkg0(atoll(buf))/
-						configpv.poll_period;
+			ediff = rapl_ediff_pkg0(atoll(buf));
+			soc_total_uj[pkg_num] += ediff;
+			col_desc[i].value = (float)ediff / col_ms;
 			break;
 
 		case PKG1_POWER_RAPL:
@@ -630,8 +804,9 @@ void do_logging(float dc)
 
 			soc_diff_uj[pkg_num] = atoll(buf) - soc_initial_energy[pkg_num];
 
-			col_desc[i].value = (float) rapl_ediff_pkg1(atoll(buf))/
-						configpv.poll_period;
+			ediff = rapl_ediff_pkg1(atoll(buf));
+			soc_total_uj[pkg_num] += ediff;
+			col_desc[i].value = (float)ediff / col_ms;
 			break;
 		case PKG2_POWER_RAPL:
 			pkg_num = i - PKG0_POWER_RAPL;
@@ -640,8 +815,9 @@ void do_logging(float dc)
 
 			soc_diff_uj[pkg_num] = atoll(buf) - soc_initial_energy[pkg_num];
 
-			col_desc[i].value = (float) rapl_ediff_pkg2(atoll(buf))/
-						configpv.poll_period;
+			ediff = rapl_ediff_pkg2(atoll(buf));
+			soc_total_uj[pkg_num] += ediff;
+			col_desc[i].value = (float)ediff / col_ms;
 			break;
 		case PKG3_POWER_RAPL:
 			pkg_num = i - PKG0_POWER_RAPL;
@@ -650,8 +826,9 @@ void do_logging(float dc)
 
 			soc_diff_uj[pkg_num] = atoll(buf) - soc_initial_energy[pkg_num];
 
-			col_desc[i].value = (float) rapl_ediff_pkg3(atoll(buf))/
-						configpv.poll_period;
+			ediff = rapl_ediff_pkg3(atoll(buf));
+			soc_total_uj[pkg_num] += ediff;
+			col_desc[i].value = (float)ediff / col_ms;
 			break;
 		case PP0_POWER_RAPL:
 			if (first_log)
@@ -659,16 +836,17 @@ void do_logging(float dc)
 
 			pp0_diff_uj = atoll(buf) - pp0_initial_energy;
 
-			col_desc[i].value = (float) rapl_ediff_cpu(atoll(buf))/
-						configpv.poll_period;
+			ediff = rapl_ediff_cpu(atoll(buf));
+			pp0_total_uj += ediff;
+			col_desc[i].value = (float)ediff / col_ms;
 			break;
 		case PP1_POWER_RAPL:
 			col_desc[i].value = (float) rapl_ediff_gpu(atoll(buf))/
-						configpv.poll_period;
+						col_ms;
 			break;
 		case DRAM_POWER_RAPL:
 			col_desc[i].value = (float) rapl_ediff_dram(atoll(buf))/
-						configpv.poll_period;
+						col_ms;
 			break;
 
 		case PKG_POWER_LIMIT:
@@ -676,6 +854,43 @@ void do_logging(float dc)
 		case SOC_DTS:
 			col_desc[i].value = atoi(buf);
 			break;
+		/* PerfCost is this sample. the others are of the previous one */
+		case SELF_JITTER_US:
+			col_desc[i].value = selfstat_last_us(SELF_JITTER);
+			break;
+		case SELF_LOG_US:
+			col_desc[i].value = selfstat_last_us(SELF_LOG);
+			break;
+		case SELF_PERF_US:
+			col_desc[i].value = selfstat_last_us(SELF_PERF);
+			break;
+		case SELF_FLUSH_US:
+			col_desc[i].value = selfstat_last_us(SELF_FLUSH);
+			break;
+		case SELF_IO_US:
+			col_desc[i].value = selfstat_last_us(SELF_IO);
+			break;
+		case PHASE_ID:
+			col_desc[i].value = scenario_phase_id();
+			break;
+		case TRACE_FREQ:
+		case TRACE_IDLE:
+			/* set by trace_freq_sample() above */
+			break;
+		case STEAL_TIME:
+			/* set by fallback_sample() above */
+			break;
+		case IDLE_SKIPPED:
+			/* set by idle_skip_sample() */
+			break;
+		case POLL_PERIOD:
+			col_desc[i].value = interval_ms;
+			break;
+		case OPS_RATE:
+		case OPS_PER_J_PKG:
+		case OPS_PER_J_CORE:
+			/* set by work_sample() below */
+			break;
 		/* dead code. happy compiler */
 		case MAX_COL_NUM:
 			break;
@@ -683,9 +898,19 @@ void do_logging(float dc)
 		}
 		col_desc[i].value *= col_desc[i].unit_multiplier;
 	}
+	work_sample(interval_ms);
+	derive_sample(interval_ms);
+	shm_export_sample();
+	metrics_update_sample();
+	rollup_sample();
+	summary_sample();
+	scenario_sample();
+	sweep_sample();
+	step_sample();
+	adaptive_sample();
 
 	if (!log_header) {
-		log_header = malloc(log_header_sz * sizeof(char));
+		log_header = malloc(log_buf_sz * sizeof(char));
 		if (!log_header) {
 			perror("Failed to malloc log_header");
 			exit(EXIT_FAILURE);
@@ -704,6 +929,9 @@ void do_logging(float dc)
 					col_desc[i].header_name);
 			sz += sz1;
 		}
+		sz += os_stats_print(log_header + sz, 0, delim);
+		sz += work_print(log_header + sz, 0, delim);
+		sz += derive_print(log_header + sz, 0, delim);
 
 		if (configpv.super_verbose && col_desc[LOAD_REALIZED].report_enabled) {
 			i = SCALE_FACTOR;
@@ -749,6 +977,9 @@ void do_logging(float dc)
 						col_desc[i].unit);
 			sz += sz1;
 		}
+		sz += os_stats_print(log_header + sz, 1, delim);
+		sz += work_print(log_header + sz, 1, delim);
+		sz += derive_print(log_header + sz, 1, delim);
 		if (configpv.super_verbose && col_desc[LOAD_REALIZED].report_enabled) {
 			i = SCALE_FACTOR;
 			for (int j = 0; j < nr_threads; j++) {
@@ -781,10 +1012,13 @@ void do_logging(float dc)
 		}
 		log_header[sz - 1] = '\n';
 
-		/* write-out to file */
-		sz = write(configpv.log_file_fd, log_header, sz);
-		if (sz == -1)
-			perror("log_header write");
+		/* write-out to file. repeated at the top of each log segment */
+		log_header_sz = sz;
+		if (!configpv.no_raw) {
+			sz = write(configpv.log_file_fd, log_header, sz);
+			if (sz == -1)
+				perror("log_header write");
+		}
 
 		printf("report being logged to %s... ^C to exit.\n", configpv.log_file_name);
 		if (configpv.verbose && !configpv.super_verbose)
@@ -800,30 +1034,33 @@ void do_logging(float dc)
 						col_desc[i].value);
 		sz += sz1;
 	}
+	sz += os_stats_print(final_buf + sz, 2, delim);
+	sz += work_print(final_buf + sz, 2, delim);
+	sz += derive_print(final_buf + sz, 2, delim);
 
 	if (configpv.super_verbose && col_desc[LOAD_REALIZED].report_enabled) {
 		int sz2;
 		i = SCALE_FACTOR;
 		for (int j = 0; j < nr_threads; j++) {
 			sprintf(val_fmt, "%%%.3sf%s", col_desc[i].fmt, delim);
-			sz2 = sprintf(final_buf+sz, val_fmt, (float) perf_stats[j].pperf_diff *
-							100/perf_stats[j].aperf_diff);
+			sz2 = sprintf(final_buf+sz, val_fmt,
+						perf_diffs.scale[j]);
 			sz += sz2;
 		}
 
 		i = LOAD_REALIZED;
 		for (int j = 0; j < nr_threads; j++) {
 			sprintf(val_fmt, "%%%.3sf%s", col_desc[i].fmt, delim);
-			sz2 = sprintf(final_buf+sz, val_fmt, (float)perf_stats[j].mperf_diff
-					*100/perf_stats[j].tsc_diff);
+			sz2 = sprintf(final_buf+sz, val_fmt,
+						perf_diffs.load[j]);
 			sz += sz2;
 		}
 
 		i = FREQ_REALIZED;
 		for (int j = 0; j < nr_threads; j++) {
 			sprintf(val_fmt, "%%%.3sf%s", col_desc[i].fmt, delim);
-			sz2 = sprintf(final_buf+sz, val_fmt, (float)perf_stats[j].aperf_diff /
-					perf_stats[j].mperf_diff*cpu_hfm_mhz);
+			sz2 = sprintf(final_buf+sz, val_fmt,
+						perf_diffs.freq[j]);
 			sz += sz2;
 		}
 	}
@@ -835,8 +1072,13 @@ void do_logging(float dc)
 
 	if (configpv.verbose && !configpv.super_verbose)
 		printf("%s", final_buf);
-	if (!exit_cpu_thread)
-		accumulate_flush_record(final_buf, sz+1);
+	if (!exit_cpu_thread && !configpv.no_raw) {
+		t0 = selfstat_start();
+		accumulate_flush_record(final_buf, sz+1,
+					col_desc[TIME_STAMP_MS].value);
+		selfstat_end(SELF_FLUSH, t0);
+	}
 
 	first_log = 0;
+	selfstat_end(SELF_LOG, t_log);
 }
@@ -47,6 +47,20 @@ typedef enum log_col {TIME_STAMP_MS,
 		      DRAM_POWER_RAPL,
 		      CPU_DTS,
 		      SOC_DTS,
+		      SELF_JITTER_US,
+		      SELF_LOG_US,
+		      SELF_PERF_US,
+		      SELF_FLUSH_US,
+		      SELF_IO_US,
+		      PHASE_ID,
+		      TRACE_FREQ,
+		      TRACE_IDLE,
+		      STEAL_TIME,
+		      IDLE_SKIPPED,
+		      POLL_PERIOD,
+		      OPS_RATE,
+		      OPS_PER_J_PKG,
+		      OPS_PER_J_CORE,
 		      MAX_COL_NUM,} log_col_t;
 
 enum col_processing { NO_FD, NORMAL_FD, MSR_FD };
@@ -59,21 +73,37 @@ struct log_col_desc {
 	float unit_multiplier;
 	enum col_processing fd_type;
 	int poll_fd;
-	float value;
+	double value;
+	int period_ms;		/* --col-period, 0: every sample */
+	double read_ms;		/* Time of the last read */
 };
 
 extern int nr_threads;
 extern int rapl_pp0_supported;
 extern int need_maxed_cpu;
 extern int plog_poll_sec, plog_poll_nsec, duration_sec, duration_nsec;
+extern struct timespec first_tm;
 extern struct config configpv;
+extern struct log_col_desc col_desc[];
+extern char *log_header;
+extern int log_header_sz;
+extern uint64_t log_record_bytes;
+extern unsigned long long log_samples;
 extern perf_stats_t *perf_stats;
 
 extern void do_logging(float dc);
+extern void log_sample(float dc, struct timespec *tm);
+extern void initialize_sampling(struct timespec *epoch);
 extern void initialize_logger(void);
-extern void initialize_log_clock(void);
+extern int initialize_col_periods(struct config *cfg);
+extern int find_column(const char *name);
+extern void initialize_log_clock(struct timespec *epoch);
+extern void set_poll_period(int ms);
+extern int find_path(char *base, char *node, char *match, char *replace,
+		     char *buf);
 extern void page_write_disk(void *);
 extern void trigger_disk_io(void);
+extern void accumulate_flush_record(char *record, int sz, double ts_ms);
 extern uint64_t diff_ns(struct timespec *, struct timespec *);
 extern int update_perf_diffs(float *s);
 #endif
@@ -0,0 +1,372 @@
+/*
+ * metrics.c: serve the latest sample in OpenMetrics text format
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+#include "logger.h"
+#include "perf_msr.h"
+#include "fallback.h"
+#include "derive.h"
+
+#define METRICS_BASE_SZ (16 * 1024)
+#define METRICS_PER_CPU_SZ 256
+/* how long a client gets to send its (http) request before we just dump */
+#define METRICS_REQ_WAIT_MS 100
+#define METRICS_ACCEPT_POLL_MS 500
+
+/*
+ * The exposition text is rendered once per poll by the logging context
+ * into the back buffer and then swapped in. A scrape only copies the
+ * front buffer out under the lock, so scrape rate never adds work to the
+ * sampling path and a slow client never blocks it.
+ */
+static char *mbuf[2];
+static int mbuf_len[2];
+static int mbuf_front;
+static int mbuf_sz;
+static uint64_t nr_samples;
+static pthread_mutex_t mmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int listen_fd = -1;
+static int is_unix_socket;
+
+static const struct {
+	log_col_t col;
+	const char *domain;
+} power_cols[] = {
+	{PKG0_POWER_RAPL, "package-0"},
+	{PKG1_POWER_RAPL, "package-1"},
+	{PKG2_POWER_RAPL, "package-2"},
+	{PKG3_POWER_RAPL, "package-3"},
+	{PP0_POWER_RAPL, "core"},
+	{PP1_POWER_RAPL, "uncore"},
+	{DRAM_POWER_RAPL, "dram"},
+};
+
+static int append(char *buf, int off, const char *fmt, ...)
+{
+	int sz;
+	va_list ap;
+
+	if (off >= mbuf_sz - 1)
+		return off;
+	va_start(ap, fmt);
+	sz = vsnprintf(buf + off, mbuf_sz - off, fmt, ap);
+	va_end(ap);
+	if (sz < 0)
+		return off;
+	return (off + sz < mbuf_sz) ? off + sz : mbuf_sz - 1;
+}
+
+/* "[mWatt]" -> "mWatt" */
+static const char *strip_unit(const char *unit, char *out, int len)
+{
+	int i, j = 0;
+
+	for (i = 0; unit[i] && j < len - 1; i++) {
+		if (unit[i] != '[' && unit[i] != ']')
+			out[j++] = unit[i];
+	}
+	out[j] = '\0';
+	return out;
+}
+
+static int render(char *buf)
+{
+	int i, t, off = 0;
+	char unit[32];
+
+	off = append(buf, off,
+		"# TYPE psst_energy_joules counter\n"
+		"# UNIT psst_energy_joules joules\n"
+		"# HELP psst_energy_joules RAPL energy consumed since psst started.\n");
+	for (i = PKG0_POWER_RAPL; i <= PKG3_POWER_RAPL; i++) {
+		if (!col_desc[i].report_enabled)
+			continue;
+		off = append(buf, off,
+			"psst_energy_joules_total{domain=\"package-%d\"} %.6f\n",
+			i - PKG0_POWER_RAPL,
+			(double)soc_total_uj[i - PKG0_POWER_RAPL] / USEC_PER_SEC);
+	}
+	if (col_desc[PP0_POWER_RAPL].report_enabled)
+		off = append(buf, off,
+			"psst_energy_joules_total{domain=\"core\"} %.6f\n",
+			(double)pp0_total_uj / USEC_PER_SEC);
+
+	off = append(buf, off,
+		"# TYPE psst_samples counter\n"
+		"# HELP psst_samples Samples taken since psst started.\n"
+		"psst_samples_total %llu\n", (unsigned long long)nr_samples);
+
+	off = append(buf, off,
+		"# TYPE psst_power_milliwatts gauge\n"
+		"# UNIT psst_power_milliwatts milliwatts\n"
+		"# HELP psst_power_milliwatts RAPL power over the last poll period.\n");
+	for (i = 0; i < (int)(sizeof(power_cols)/sizeof(power_cols[0])); i++) {
+		if (!col_desc[power_cols[i].col].report_enabled)
+			continue;
+		off = append(buf, off,
+			"psst_power_milliwatts{domain=\"%s\"} %.2f\n",
+			power_cols[i].domain, col_desc[power_cols[i].col].value);
+	}
+
+	off = append(buf, off,
+		"# TYPE psst_temperature_celsius gauge\n"
+		"# UNIT psst_temperature_celsius celsius\n");
+	if (col_desc[CPU_DTS].report_enabled)
+		off = append(buf, off,
+			"psst_temperature_celsius{sensor=\"cpu\"} %.2f\n",
+			col_desc[CPU_DTS].value);
+	if (col_desc[SOC_DTS].report_enabled)
+		off = append(buf, off,
+			"psst_temperature_celsius{sensor=\"soc\"} %.2f\n",
+			col_desc[SOC_DTS].value);
+
+	off = append(buf, off,
+		"# TYPE psst_load_requested_percent gauge\n"
+		"# UNIT psst_load_requested_percent percent\n"
+		"psst_load_requested_percent %.2f\n",
+		col_desc[LOAD_REQUEST].value);
+
+	if (perf_stats[0].dev_msr_supported || perf_fallback) {
+		off = append(buf, off,
+			"# TYPE psst_cpu_load_percent gauge\n"
+			"# UNIT psst_cpu_load_percent percent\n"
+			"# HELP psst_cpu_load_percent Realized C0 residency.\n");
+		for (t = 0; t < nr_threads; t++)
+			off = append(buf, off,
+				"psst_cpu_load_percent{cpu=\"%d\"} %.2f\n",
+				perf_stats[t].cpu, perf_diffs.load[t]);
+		off = append(buf, off,
+			"# TYPE psst_cpu_frequency_mhz gauge\n"
+			"# UNIT psst_cpu_frequency_mhz mhz\n"
+			"# HELP psst_cpu_frequency_mhz Average frequency while in C0.\n");
+		for (t = 0; t < nr_threads; t++)
+			off = append(buf, off,
+				"psst_cpu_frequency_mhz{cpu=\"%d\"} %.0f\n",
+				perf_stats[t].cpu, perf_diffs.freq[t]);
+	}
+
+	/* every logged column as-is, so new columns show up without code */
+	off = append(buf, off,
+		"# TYPE psst_column gauge\n"
+		"# HELP psst_column Latest value of each logged column.\n");
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (!col_desc[i].report_enabled)
+			continue;
+		off = append(buf, off,
+			"psst_column{column=\"%s\",unit=\"%s\"} %.3f\n",
+			col_desc[i].header_name,
+			strip_unit(col_desc[i].unit, unit, sizeof(unit)),
+			col_desc[i].value);
+	}
+	for (i = 0; i < nr_derived; i++)
+		off = append(buf, off,
+			"psst_column{column=\"%s\",unit=\"\"} %.3f\n",
+			derive_name(i), derive_value(i));
+	off = append(buf, off, "# EOF\n");
+	return off;
+}
+
+/* called from the logging context once column values are final */
+void metrics_update_sample(void)
+{
+	int back;
+
+	if (listen_fd == -1)
+		return;
+
+	nr_samples++;
+	back = !mbuf_front;
+	mbuf_len[back] = render(mbuf[back]);
+
+	pthread_mutex_lock(&mmutex);
+	mbuf_front = back;
+	pthread_mutex_unlock(&mmutex);
+}
+
+static void send_all(int fd, char *buf, int sz)
+{
+	int ret;
+
+	while (sz > 0) {
+		ret = send(fd, buf, sz, MSG_NOSIGNAL);
+		if (ret <= 0)
+			return;
+		buf += ret;
+		sz -= ret;
+	}
+}
+
+static void serve_client(int fd, char *out)
+{
+	int sz, len;
+	char req[1024], hdr[256];
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	/*
+	 * http clients (prometheus, curl) get a http response. anything
+	 * silent for a moment (nc, socat) gets the bare exposition text.
+	 */
+	req[0] = '\0';
+	if (poll(&pfd, 1, METRICS_REQ_WAIT_MS) > 0) {
+		sz = recv(fd, req, sizeof(req) - 1, 0);
+		req[sz > 0 ? sz : 0] = '\0';
+	}
+
+	pthread_mutex_lock(&mmutex);
+	len = mbuf_len[mbuf_front];
+	memcpy(out, mbuf[mbuf_front], len);
+	pthread_mutex_unlock(&mmutex);
+
+	if (!strncmp(req, "GET ", 4)) {
+		sz = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/openmetrics-text; "
+			"version=1.0.0; charset=utf-8\r\n"
+			"Content-Length: %d\r\n"
+			"Connection: close\r\n\r\n", len);
+		send_all(fd, hdr, sz);
+	}
+	send_all(fd, out, len);
+}
+
+void metrics_serve(void *arg)
+{
+	int fd, ret;
+	char *out;
+	sigset_t sigmask;
+	struct pollfd pfd;
+
+	UNUSED(arg);
+	sigfillset(&sigmask);
+	ret = pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+	if (ret)
+		printf("metrics_serve: couldn't mask signals. err:%d\n", ret);
+
+	out = malloc(mbuf_sz);
+	if (!out) {
+		perror("malloc metrics out");
+		pthread_exit(NULL);
+	}
+
+	pfd.fd = listen_fd;
+	pfd.events = POLLIN;
+	while (!exit_cpu_thread) {
+		if (poll(&pfd, 1, METRICS_ACCEPT_POLL_MS) <= 0)
+			continue;
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1)
+			continue;
+		serve_client(fd, out);
+		close(fd);
+	}
+	free(out);
+	pthread_exit(NULL);
+}
+
+/*
+ * --metrics takes either /path/to/unix.sock or a tcp port. tcp is bound
+ * to 127.0.0.1 only; this is not meant to face the network.
+ */
+int initialize_metrics(struct config *cfg)
+{
+	int port, one = 1;
+	struct sockaddr_un sun;
+	struct sockaddr_in sin;
+
+	if (!cfg->metrics_addr[0])
+		return 1;
+
+	mbuf_sz = METRICS_BASE_SZ + nr_threads * METRICS_PER_CPU_SZ;
+	mbuf[0] = malloc(mbuf_sz);
+	mbuf[1] = malloc(mbuf_sz);
+	if (!mbuf[0] || !mbuf[1]) {
+		perror("malloc metrics buffer");
+		return 0;
+	}
+	/* scrapes before the first sample get a valid, empty exposition */
+	mbuf_len[0] = sprintf(mbuf[0], "# EOF\n");
+
+	if (cfg->metrics_addr[0] == '/') {
+		is_unix_socket = 1;
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (listen_fd == -1) {
+			perror("metrics socket");
+			return 0;
+		}
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strncpy(sun.sun_path, cfg->metrics_addr, sizeof(sun.sun_path) - 1);
+		unlink(sun.sun_path);
+		if (bind(listen_fd, (struct sockaddr *)&sun, sizeof(sun))) {
+			perror("metrics bind");
+			goto err;
+		}
+	} else {
+		port = atoi(cfg->metrics_addr);
+		if (port <= 0 || port > 65535) {
+			printf("invalid metrics port %s\n", cfg->metrics_addr);
+			return 0;
+		}
+		listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (listen_fd == -1) {
+			perror("metrics socket");
+			return 0;
+		}
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(listen_fd, (struct sockaddr *)&sin, sizeof(sin))) {
+			perror("metrics bind");
+			goto err;
+		}
+	}
+	if (listen(listen_fd, 8)) {
+		perror("metrics listen");
+		goto err;
+	}
+	return 1;
+err:
+	close(listen_fd);
+	listen_fd = -1;
+	return 0;
+}
+
+void finish_metrics(struct config *cfg)
+{
+	if (listen_fd == -1)
+		return;
+
+	close(listen_fd);
+	listen_fd = -1;
+	if (is_unix_socket)
+		unlink(cfg->metrics_addr);
+}
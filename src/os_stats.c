@@ -0,0 +1,354 @@
+/*
+ * os_stats.c: cpufreq/cpuidle sysfs residency columns (--os-stats)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "os_stats.h"
+#include "control.h"
+#include "logger.h"
+
+/*
+ * What the OS thinks each --cpumask cpu did, next to the MSR columns:
+ *	CurFNN	scaling_cur_freq at the sample
+ *	TisFNN	mean of cpufreq/stats/time_in_state over the interval
+ *	EppNN	energy_performance_preference as HWP value (0 performance ..
+ *		255 power, -1 default); a change is also marked in the log
+ *	<state>NN	% of the interval in each cpuidle state
+ *	WakeNN	cpuidle entries per second, all states
+ * All files are opened once and read with pread; cumulative counters are
+ * diffed against the previous sample. A kind of column is logged when the
+ * first selected cpu has its file; other cpus without it log 0.
+ */
+#define OS_READ_BUF (4096)
+#define MAX_PSTATES (64)
+#define OS_COL_WIDTH (8)
+
+struct idle_state {
+	int usage_fd, time_fd;
+	uint64_t usage, time_us;
+	double pct;
+};
+
+struct os_cpu {
+	int cpu;
+	int cur_fd, tis_fd, epp_fd;
+	uint64_t tis_khz[MAX_PSTATES], tis_t[MAX_PSTATES];
+	int nr_tis;
+	struct idle_state idle[MAX_IDLE_STATES];
+	double cur_mhz, tis_mhz, wake_hz;
+	int epp;
+};
+
+static int os_enabled;
+static struct os_cpu *oc;
+static int nr_oc;
+static int have_cur, have_tis, have_epp;
+static int nr_idle;
+static char idle_name[MAX_IDLE_STATES][8];
+static struct timespec os_last_tm;
+
+static int open_cpu_file(int cpu, const char *node)
+{
+	char path[MAX_LEN];
+
+	snprintf(path, sizeof(path), "%s%s/cpu%d/%s", configpv.hw_root,
+						SYSFS_CPU_PATH, cpu, node);
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int pread_str(int fd, char *buf, int len)
+{
+	int sz;
+
+	if (fd < 0)
+		return 0;
+	sz = pread(fd, buf, len - 1, 0);
+	if (sz <= 0)
+		return 0;
+	buf[sz] = '\0';
+	return sz;
+}
+
+static uint64_t pread_u64(int fd)
+{
+	char buf[32];
+
+	return pread_str(fd, buf, sizeof(buf)) ? strtoull(buf, NULL, 10) : 0;
+}
+
+/* HWP EPP values intel_pstate writes for the named preferences */
+static int epp_value(char *s)
+{
+	static const struct {
+		const char *name;
+		int val;
+	} prefs[] = {
+		{ "performance", 0 },
+		{ "balance_performance", 128 },
+		{ "balance_power", 192 },
+		{ "power", 255 },
+	};
+	unsigned int i;
+
+	s[strcspn(s, "\n")] = '\0';
+	if (s[0] >= '0' && s[0] <= '9')
+		return atoi(s);
+	for (i = 0; i < sizeof(prefs) / sizeof(prefs[0]); i++) {
+		if (!strcmp(s, prefs[i].name))
+			return prefs[i].val;
+	}
+	return -1;
+}
+
+/* "khz time" lines, time in 10 ms units. returns mean MHz since last */
+static double read_tis(struct os_cpu *c, int first)
+{
+	char buf[OS_READ_BUF], *line, *save;
+	uint64_t khz, t, dt, sum_dt = 0;
+	double sum_f = 0;
+	int n = 0;
+
+	if (!pread_str(c->tis_fd, buf, sizeof(buf)))
+		return 0;
+	for (line = strtok_r(buf, "\n", &save); line && n < MAX_PSTATES;
+				line = strtok_r(NULL, "\n", &save), n++) {
+		if (sscanf(line, "%llu %llu", (unsigned long long *)&khz,
+					(unsigned long long *)&t) != 2)
+			break;
+		if (!first && n < c->nr_tis && c->tis_khz[n] == khz &&
+							t >= c->tis_t[n]) {
+			dt = t - c->tis_t[n];
+			sum_dt += dt;
+			sum_f += (double)khz * dt;
+		}
+		c->tis_khz[n] = khz;
+		c->tis_t[n] = t;
+	}
+	c->nr_tis = n;
+	return sum_dt ? sum_f / sum_dt / 1000 : 0;
+}
+
+static void read_cpu(struct os_cpu *c, double interval_us, int first)
+{
+	char buf[64], text[MAX_MARK_LEN];
+	uint64_t usage, time_us, wakes = 0;
+	int s, epp;
+
+	if (have_cur)
+		c->cur_mhz = (double)pread_u64(c->cur_fd) / 1000;
+	if (have_tis)
+		c->tis_mhz = read_tis(c, first);
+	if (have_epp && pread_str(c->epp_fd, buf, sizeof(buf))) {
+		epp = epp_value(buf);
+		if (!first && epp != c->epp) {
+			snprintf(text, sizeof(text), "epp cpu%d: %d -> %d",
+						c->cpu, c->epp, epp);
+			control_mark(text);
+		}
+		c->epp = epp;
+	}
+
+	for (s = 0; s < nr_idle; s++) {
+		usage = pread_u64(c->idle[s].usage_fd);
+		time_us = pread_u64(c->idle[s].time_fd);
+		if (!first) {
+			wakes += usage - c->idle[s].usage;
+			c->idle[s].pct = interval_us > 0 ?
+				(double)(time_us - c->idle[s].time_us) * 100 /
+							interval_us : 0;
+		}
+		c->idle[s].usage = usage;
+		c->idle[s].time_us = time_us;
+	}
+	c->wake_hz = interval_us > 0 ? wakes * 1000000.0 / interval_us : 0;
+}
+
+int initialize_os_stats(struct config *cfg)
+{
+	char node[64], name[32];
+	int cpu, s, fd, i = 0;
+
+	if (!cfg->os_stats)
+		return 1;
+
+	nr_oc = CPU_COUNT(&cfg->cpumask);
+	oc = calloc(nr_oc, sizeof(struct os_cpu));
+	if (!oc) {
+		perror("calloc os_stats");
+		return 0;
+	}
+
+	/* idle state names of the first cpu name the columns */
+	cpu = 0;
+	while (cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &cfg->cpumask))
+		cpu++;
+	for (s = 0; s < MAX_IDLE_STATES; s++) {
+		snprintf(node, sizeof(node), "cpuidle/state%d/name", s);
+		fd = open_cpu_file(cpu, node);
+		if (fd < 0)
+			break;
+		if (!pread_str(fd, name, sizeof(name)))
+			snprintf(name, sizeof(name), "S%d", s);
+		name[strcspn(name, "\n")] = '\0';
+		/* two digits of cpu# follow in the header */
+		snprintf(idle_name[s], sizeof(idle_name[s]), "%.5s", name);
+		close(fd);
+	}
+	nr_idle = s;
+
+	for (cpu = 0; cpu < CPU_SETSIZE && i < nr_oc; cpu++) {
+		if (!CPU_ISSET(cpu, &cfg->cpumask))
+			continue;
+		oc[i].cpu = cpu;
+		oc[i].cur_fd = open_cpu_file(cpu, "cpufreq/scaling_cur_freq");
+		oc[i].tis_fd = open_cpu_file(cpu,
+					"cpufreq/stats/time_in_state");
+		oc[i].epp_fd = open_cpu_file(cpu,
+				"cpufreq/energy_performance_preference");
+		for (s = 0; s < nr_idle; s++) {
+			snprintf(node, sizeof(node), "cpuidle/state%d/usage", s);
+			oc[i].idle[s].usage_fd = open_cpu_file(cpu, node);
+			snprintf(node, sizeof(node), "cpuidle/state%d/time", s);
+			oc[i].idle[s].time_fd = open_cpu_file(cpu, node);
+		}
+		i++;
+	}
+	have_cur = oc[0].cur_fd >= 0;
+	have_tis = oc[0].tis_fd >= 0;
+	have_epp = oc[0].epp_fd >= 0;
+	if (!have_cur && !have_tis && !have_epp && !nr_idle) {
+		printf("--os-stats: no cpufreq or cpuidle in %s\n",
+							SYSFS_CPU_PATH);
+		return 0;
+	}
+
+	for (i = 0; i < nr_oc; i++)
+		read_cpu(&oc[i], 0, 1);
+	if (clock_gettime(CLOCK_MONOTONIC, &os_last_tm))
+		perror("clock_gettime");
+	os_enabled = 1;
+	return 1;
+}
+
+/* sampling context, tm being the time of the poll */
+void os_stats_sample(struct timespec *tm)
+{
+	double interval_us;
+	int i;
+
+	if (!os_enabled)
+		return;
+	interval_us = ts_compare(tm, &os_last_tm) > 0 ?
+			(double)diff_ns(&os_last_tm, tm) / 1000 : 0;
+	os_last_tm = *tm;
+	for (i = 0; i < nr_oc; i++)
+		read_cpu(&oc[i], interval_us, 0);
+}
+
+/* log record bytes the columns may take */
+int os_stats_width(void)
+{
+	if (!os_enabled)
+		return 0;
+	return nr_oc * (4 + nr_idle) * 32;
+}
+
+/*
+ * Header (row 0: names, 1: units) or values, appended to buf with delim
+ * after each column. Returns bytes written.
+ */
+int os_stats_print(char *buf, int row, const char *delim)
+{
+	static const char *unit[] = { "[MHz]", "[MHz]", "[#]" };
+	static const char *name[] = { "CurF", "TisF", "Epp" };
+	int have[] = { have_cur, have_tis, have_epp };
+	double v;
+	int sz = 0, i, k, s;
+
+	if (!os_enabled)
+		return 0;
+	for (i = 0; i < nr_oc; i++) {
+		for (k = 0; k < 3; k++) {
+			if (!have[k])
+				continue;
+			v = k == 0 ? oc[i].cur_mhz : k == 1 ? oc[i].tis_mhz :
+								oc[i].epp;
+			if (row == 0)
+				sz += sprintf(buf + sz, "%*s%.2d%s",
+					OS_COL_WIDTH - 2, name[k], oc[i].cpu,
+					delim);
+			else if (row == 1)
+				sz += sprintf(buf + sz, "%*s%s", OS_COL_WIDTH,
+						unit[k], delim);
+			else
+				sz += sprintf(buf + sz, "%*.*f%s",
+					OS_COL_WIDTH, k == 2 ? 0 : 2, v, delim);
+		}
+		for (s = 0; s < nr_idle; s++) {
+			if (row == 0)
+				sz += sprintf(buf + sz, "%*s%.2d%s",
+					OS_COL_WIDTH - 2, idle_name[s],
+					oc[i].cpu, delim);
+			else if (row == 1)
+				sz += sprintf(buf + sz, "%*s%s", OS_COL_WIDTH,
+							"[%]", delim);
+			else
+				sz += sprintf(buf + sz, "%*.2f%s",
+					OS_COL_WIDTH, oc[i].idle[s].pct, delim);
+		}
+		if (!nr_idle)
+			continue;
+		if (row == 0)
+			sz += sprintf(buf + sz, "%*s%.2d%s", OS_COL_WIDTH - 2,
+						"Wake", oc[i].cpu, delim);
+		else if (row == 1)
+			sz += sprintf(buf + sz, "%*s%s", OS_COL_WIDTH, "[/s]",
+								delim);
+		else
+			sz += sprintf(buf + sz, "%*.1f%s", OS_COL_WIDTH,
+						oc[i].wake_hz, delim);
+	}
+	return sz;
+}
+
+void finish_os_stats(void)
+{
+	int i, s;
+
+	if (!os_enabled)
+		return;
+	os_enabled = 0;
+	for (i = 0; i < nr_oc; i++) {
+		if (oc[i].cur_fd >= 0)
+			close(oc[i].cur_fd);
+		if (oc[i].tis_fd >= 0)
+			close(oc[i].tis_fd);
+		if (oc[i].epp_fd >= 0)
+			close(oc[i].epp_fd);
+		for (s = 0; s < nr_idle; s++) {
+			if (oc[i].idle[s].usage_fd >= 0)
+				close(oc[i].idle[s].usage_fd);
+			if (oc[i].idle[s].time_fd >= 0)
+				close(oc[i].idle[s].time_fd);
+		}
+	}
+	free(oc);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _OS_STATS_H_
+#define _OS_STATS_H_
+#include <time.h>
+#include "parse_config.h"
+
+#ifndef SYSFS_CPU_PATH
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu"
+#endif
+/* CPUIDLE_STATE_MAX of the kernel */
+#define MAX_IDLE_STATES (10)
+
+extern int initialize_os_stats(struct config *cfg);
+extern void os_stats_sample(struct timespec *tm);
+extern int os_stats_width(void);
+extern int os_stats_print(char *buf, int row, const char *delim);
+extern void finish_os_stats(void);
+#endif
@@ -27,6 +27,41 @@
 
 #include "parse_config.h"
 #include "logger.h"
+#include "log_rotate.h"
+#include "scenario.h"
+#include "burst.h"
+
+/* options without a short form. kept clear of the ascii range */
+enum long_only_option {
+	OPT_ROTATE_SIZE = 256,
+	OPT_ROTATE_TIME,
+	OPT_ROTATE_KEEP,
+	OPT_SHM,
+	OPT_METRICS,
+	OPT_ROLLUP,
+	OPT_NO_RAW,
+	OPT_SUMMARY,
+	OPT_ABOVE,
+	OPT_SAMPLER_CPU,
+	OPT_SELF_STATS,
+	OPT_PHASE,
+	OPT_SCHED,
+	OPT_CONTROL,
+	OPT_SCENARIO,
+	OPT_SWEEP,
+	OPT_STEP_RESPONSE,
+	OPT_BURST,
+	OPT_TRIGGER,
+	OPT_EVENTS,
+	OPT_TRACE_FREQ,
+	OPT_OS_STATS,
+	OPT_IDLE_SKIP,
+	OPT_COL_PERIOD,
+	OPT_ADAPTIVE_POLL,
+	OPT_DERIVE,
+	OPT_OPS,
+	OPT_HW_ROOT,
+};
 
 static struct option long_options[] = {
 	{"cpumask",     1,      0,      'C'},
@@ -39,6 +74,34 @@ static struct option long_options[] = {
 	{"super-verbose",0,     0,      'S'},
 	{"version",     0,      0,      'V'},
 	{"help",        0,      0,      'h'},
+	{"rotate-size", 1,      0,      OPT_ROTATE_SIZE},
+	{"rotate-time", 1,      0,      OPT_ROTATE_TIME},
+	{"rotate-keep", 1,      0,      OPT_ROTATE_KEEP},
+	{"shm",         1,      0,      OPT_SHM},
+	{"metrics",     1,      0,      OPT_METRICS},
+	{"rollup",      1,      0,      OPT_ROLLUP},
+	{"no-raw",      0,      0,      OPT_NO_RAW},
+	{"summary",     1,      0,      OPT_SUMMARY},
+	{"above",       1,      0,      OPT_ABOVE},
+	{"sampler-cpu", 1,      0,      OPT_SAMPLER_CPU},
+	{"self-stats",  0,      0,      OPT_SELF_STATS},
+	{"phase",       1,      0,      OPT_PHASE},
+	{"sched",       1,      0,      OPT_SCHED},
+	{"control",     1,      0,      OPT_CONTROL},
+	{"scenario",    1,      0,      OPT_SCENARIO},
+	{"sweep",       1,      0,      OPT_SWEEP},
+	{"step-response", 1,    0,      OPT_STEP_RESPONSE},
+	{"burst",       1,      0,      OPT_BURST},
+	{"trigger",     1,      0,      OPT_TRIGGER},
+	{"events",      1,      0,      OPT_EVENTS},
+	{"trace-freq",  0,      0,      OPT_TRACE_FREQ},
+	{"os-stats",    0,      0,      OPT_OS_STATS},
+	{"idle-skip",   0,      0,      OPT_IDLE_SKIP},
+	{"col-period",  1,      0,      OPT_COL_PERIOD},
+	{"adaptive-poll", 1,    0,      OPT_ADAPTIVE_POLL},
+	{"derive",      1,      0,      OPT_DERIVE},
+	{"ops",         0,      0,      OPT_OPS},
+	{"hw-root",     1,      0,      OPT_HW_ROOT},
 	{0, 0, 0, 0}
 };
 
@@ -50,8 +113,36 @@ void print_usage(char *prog)
 	printf("\t-C|--cpumask\t\t<CPUMASK> hex bit mask of cpu# to be selected.\n");
 	printf("\t\t\t\t(e.g., a1 selects cpu 0,5,7. default: every online cpu. Max:400 [1024])\n");
 	printf("\t-p|--poll-period\t<pollperiod> (ms) for logging (default: 500 ms)\n");
+	printf("\t--col-period\t\t<column=ms> read a sysfs column only every ms, a multiple of poll period (repeatable)\n");
+	printf("\t--adaptive-poll\t\t<floor,ceiling> (ms) poll at floor while freq, load or power change, relax up to ceiling\n");
 	printf("\t-d|--duration\t\t<duration> (ms) to run the tool (default: 3600000 i.e., 1hr)\n");
 	printf("\t-l|--log-file\t\t</path/to/log-file> (default: %s)\n", default_log_file);
+	printf("\t--rotate-size\t\t<MB> roll log over to a new segment <log-file>.NNNNN after MB\n");
+	printf("\t--rotate-time\t\t<sec> roll log over to a new segment every sec seconds\n");
+	printf("\t--rotate-keep\t\t<N> keep only the latest N segments (default: keep all)\n");
+	printf("\t--shm\t\t\t<name> publish latest sample to /dev/shm/<name> (see src/psst_shm.h)\n");
+	printf("\t--metrics\t\t<port|/path.sock> serve OpenMetrics text on 127.0.0.1:port or unix socket\n");
+	printf("\t--rollup\t\t<ms[,ms..]> min/max/mean/stddev of each column per window to <log-file>.rollup-<ms>ms\n");
+	printf("\t--no-raw\t\tdo not write per-sample records to the log file (use with --rollup)\n");
+	printf("\t--summary\t\t</path/to/file.json> write end-of-run quantiles & distributions\n");
+	printf("\t--above\t\t\t<column=value> count time column spent above value in summary (repeatable)\n");
+	printf("\t--derive\t\t<name=expr> log a column computed from other columns & per cpu counters (repeatable)\n");
+	printf("\t--sampler-cpu\t\t<N> sample from a timer driven thread on cpu N (default: inline on cpu0)\n");
+	printf("\t--self-stats\t\tlog psst's own sample jitter & overhead columns, report at exit\n");
+	printf("\t--phase\t\t\t<in|stagger|random> ON window of each cpu in tick: aligned, evenly spread or random (default: in)\n");
+	printf("\t--sched\t\t\t<other|fifo|rr|deadline> scheduling class of workers (default: other)\n");
+	printf("\t--control\t\t</path.sock> accept run-time commands on unix socket\n");
+	printf("\t--scenario\t\t</path/to/plan> run the phases of a test plan back to back\n");
+	printf("\t--sweep\t\t\t<from:to:step[@cores,..]> perf/W table over load levels (and core counts)\n");
+	printf("\t--step-response\t\t<low,high,period_ms[,edges]> rise/overshoot/settling of freq, load & power per load step\n");
+	printf("\t--burst\t\t\t<us[,pre_ms,post_ms]> ring of raw counters every us, dumped around each trigger (default window 50,50)\n");
+	printf("\t--trigger\t\t<shape|power>mW|temp+DegC|freq-MHz> burst capture trigger (repeatable)\n");
+	printf("\t--events\t\t<log|trace> mark duty cycle changes too; trace: also to tracefs trace_marker\n");
+	printf("\t--trace-freq\t\tTrFreq/TrIdle columns & <log-file>.trace timeline from power tracepoints\n");
+	printf("\t--os-stats\t\tper cpu cpufreq (cur, time_in_state, EPP) & cpuidle residency columns\n");
+	printf("\t--ops\t\t\tlog work done by the workers: Mop/s per cpu & total, Mop/J of package & core\n");
+	printf("\t--idle-skip\t\tdon't wake cpus idle since the last sample to read their MSRs\n");
+	printf("\t--hw-root\t\t</path> read MSR, powercap, thermal & cpu sysfs files under path (e.g., a mock tree)\n");
 	printf("\t-v|--verbose\t\tenables verbose mode (default: disabled when args specified)\n");
 	printf("\t-S|--super-verbose\tprint per-core info (e.g., util) to log file (default: disabled)\n");
 	printf("\t-V|--version\t\tprints version when specified\n");
@@ -127,7 +218,11 @@ int populate_default_config(struct config *configp)
 	if (!configp->cpu_freq)
 		configp->cpu_freq = -1;
 
-	if (!configp->log_file_fd) {
+	if (!configp->log_file_fd && log_rotate_enabled(configp)) {
+		/* segment index <log-file>.idx maps time ranges to segments */
+		if (!initialize_log_rotate(configp))
+			return 0;
+	} else if (!configp->log_file_fd) {
 		configp->log_file_fd = open(configp->log_file_name,
 				O_RDWR|O_CREAT|O_TRUNC,
 				S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
@@ -137,9 +232,13 @@ int populate_default_config(struct config *configp)
 	if (!configp->poll_period)
 		configp->poll_period = 500; /* (ms) */
 	if (!configp->duration)
-		configp->duration = 3600000; /* default 60min */
+		configp->duration = (configp->scenario_file[0] ||
+				configp->sweep || configp->step_period_ms) ?
+			SCENARIO_DURATION_MS : 3600000; /* default 60min */
 
 	initialize_logger();
+	if (!initialize_col_periods(configp))
+		return 0;
 	if (configp->verbose | configp->super_verbose)
 		verbose_prints(configp);
 
@@ -158,7 +257,7 @@ static int xchar_to_int(char x)
 /* cpuset procfs reports online cpu in this format:
  * 0-4,7 : to mean 0,1,2,3,4 & 7 are online
  */
-static int cpuset_to_bitmap(char *buf, cpu_set_t *cpumask)
+int cpuset_to_bitmap(char *buf, cpu_set_t *cpumask)
 {
 	int k;
 	char *token, *subtoken, *pos;
@@ -220,6 +319,57 @@ static int populate_online_cpumask(cpu_set_t *cpumask)
 cpu_stress_opt_t cpu_stress_opt = UNDEFINED;
 int dont_stress_cpu0;
 
+/* "1000,10000,60000" */
+static int parse_rollup(char *buf, struct config *configp)
+{
+	char *token, *save;
+
+	token = strtok_r(buf, ",", &save);
+	while (token) {
+		if (configp->nr_rollups == MAX_ROLLUPS) {
+			printf("max %d rollup windows\n", MAX_ROLLUPS);
+			return -1;
+		}
+		configp->rollup_ms[configp->nr_rollups] = atoi(token);
+		if (configp->rollup_ms[configp->nr_rollups] <= 0)
+			return -1;
+		configp->nr_rollups++;
+		token = strtok_r(NULL, ",", &save);
+	}
+	return 0;
+}
+
+/* from:to:step[@cores,cores..] */
+static int parse_sweep(char *buf, struct config *configp)
+{
+	char *token, *save, *cores;
+
+	cores = strchr(buf, '@');
+	if (cores)
+		*cores++ = '\0';
+	if (sscanf(buf, "%f:%f:%f", &configp->sweep_from, &configp->sweep_to,
+					&configp->sweep_step) != 3 ||
+	    configp->sweep_from < MIN_LOAD || configp->sweep_to > MAX_LOAD ||
+	    configp->sweep_from > configp->sweep_to ||
+	    configp->sweep_step <= 0)
+		return -1;
+
+	token = cores ? strtok_r(cores, ",", &save) : NULL;
+	while (token) {
+		if (configp->nr_sweep_cores == MAX_SWEEP_CORES) {
+			printf("max %d --sweep core counts\n", MAX_SWEEP_CORES);
+			return -1;
+		}
+		configp->sweep_cores[configp->nr_sweep_cores] = atoi(token);
+		if (configp->sweep_cores[configp->nr_sweep_cores] <= 0)
+			return -1;
+		configp->nr_sweep_cores++;
+		token = strtok_r(NULL, ",", &save);
+	}
+	configp->sweep = 1;
+	return 0;
+}
+
 static int set_cpu_mask(char *buf, struct config *configp)
 {
 	int arg_bytes = strlen(buf);
@@ -262,6 +412,7 @@ int parse_cmd_config(int ac, char **av, struct config *configp)
 
 	memset(configp, 0, sizeof(struct config));
 	CPU_ZERO(&configp->cpumask);
+	configp->sampler_cpu = -1;
 
 	if (ac == 1)
 		configp->verbose = 1;
@@ -281,7 +432,7 @@ int parse_cmd_config(int ac, char **av, struct config *configp)
 				return 0;
 			break;
 		case 'd':
-			sscanf(optarg, "%d", &configp->duration);
+			sscanf(optarg, "%lld", &configp->duration);
 			if (configp->duration <= 0)
 				return 0;
 			break;
@@ -307,6 +458,210 @@ int parse_cmd_config(int ac, char **av, struct config *configp)
 			strncpy(configp->shape_func, optarg, len);
 			configp->shape_func[len - 1] = '\0';
 			break;
+		case OPT_ROTATE_SIZE:
+			sscanf(optarg, "%lld", &configp->rotate_size);
+			if (configp->rotate_size <= 0)
+				return 0;
+			configp->rotate_size *= 1024 * 1024;
+			break;
+		case OPT_ROTATE_TIME:
+			sscanf(optarg, "%d", &configp->rotate_time);
+			if (configp->rotate_time <= 0)
+				return 0;
+			break;
+		case OPT_ROTATE_KEEP:
+			sscanf(optarg, "%d", &configp->rotate_keep);
+			if (configp->rotate_keep <= 0)
+				return 0;
+			break;
+		case OPT_SHM:
+			len = sizeof(configp->shm_name);
+			strncpy(configp->shm_name, optarg, len);
+			configp->shm_name[len - 1] = '\0';
+			if (strchr(configp->shm_name, '/'))
+				return 0;
+			break;
+		case OPT_METRICS:
+			len = sizeof(configp->metrics_addr);
+			strncpy(configp->metrics_addr, optarg, len);
+			configp->metrics_addr[len - 1] = '\0';
+			break;
+		case OPT_ROLLUP:
+			sscanf(optarg, "%127s", buf);
+			if (parse_rollup(buf, configp) < 0)
+				return 0;
+			break;
+		case OPT_NO_RAW:
+			configp->no_raw = 1;
+			break;
+		case OPT_SUMMARY:
+			len = sizeof(configp->summary_file);
+			strncpy(configp->summary_file, optarg, len);
+			configp->summary_file[len - 1] = '\0';
+			break;
+		case OPT_ABOVE:
+			if (configp->nr_above == MAX_THRESHOLDS) {
+				printf("max %d --above thresholds\n", MAX_THRESHOLDS);
+				return 0;
+			}
+			if (sscanf(optarg, "%31[^=]=%lf",
+				   configp->above_col[configp->nr_above],
+				   &configp->above_val[configp->nr_above]) != 2) {
+				printf("--above expects column=value\n");
+				return 0;
+			}
+			configp->nr_above++;
+			break;
+		case OPT_SAMPLER_CPU:
+			configp->sampler_cpu = atoi(optarg);
+			if (configp->sampler_cpu < 0 ||
+			    configp->sampler_cpu >= CPU_SETSIZE) {
+				printf("--sampler-cpu: invalid cpu %s\n", optarg);
+				return 0;
+			}
+			break;
+		case OPT_SELF_STATS:
+			configp->self_stats = 1;
+			break;
+		case OPT_PHASE:
+			if (!strcmp(optarg, "in")) {
+				configp->phase = PHASE_IN;
+			} else if (!strcmp(optarg, "stagger")) {
+				configp->phase = PHASE_STAGGER;
+			} else if (!strcmp(optarg, "random")) {
+				configp->phase = PHASE_RANDOM;
+			} else {
+				printf("--phase expects in, stagger or random\n");
+				return 0;
+			}
+			break;
+		case OPT_SCHED:
+			if (!strcmp(optarg, "other")) {
+				configp->sched_policy = SCHED_OTHER;
+			} else if (!strcmp(optarg, "fifo")) {
+				configp->sched_policy = SCHED_FIFO;
+			} else if (!strcmp(optarg, "rr")) {
+				configp->sched_policy = SCHED_RR;
+			} else if (!strcmp(optarg, "deadline")) {
+				configp->sched_policy = SCHED_DEADLINE;
+			} else {
+				printf("--sched expects other, fifo, rr or deadline\n");
+				return 0;
+			}
+			break;
+		case OPT_CONTROL:
+			len = sizeof(configp->control_path);
+			strncpy(configp->control_path, optarg, len);
+			configp->control_path[len - 1] = '\0';
+			break;
+		case OPT_SCENARIO:
+			len = sizeof(configp->scenario_file);
+			strncpy(configp->scenario_file, optarg, len);
+			configp->scenario_file[len - 1] = '\0';
+			break;
+		case OPT_SWEEP:
+			sscanf(optarg, "%127s", buf);
+			if (parse_sweep(buf, configp) < 0) {
+				printf("--sweep expects from:to:step[@cores,..]\n");
+				return 0;
+			}
+			break;
+		case OPT_STEP_RESPONSE:
+			if (sscanf(optarg, "%f,%f,%d,%d", &configp->step_low,
+				   &configp->step_high, &configp->step_period_ms,
+				   &configp->step_edges) < 3 ||
+			    configp->step_low < MIN_LOAD ||
+			    configp->step_high > MAX_LOAD ||
+			    configp->step_low >= configp->step_high ||
+			    configp->step_period_ms < 100 ||
+			    configp->step_edges < 0) {
+				printf("--step-response expects low,high,period_ms[,edges] with period_ms >= 100\n");
+				return 0;
+			}
+			break;
+		case OPT_BURST:
+			configp->burst_pre_ms = BURST_DEFAULT_WINDOW_MS;
+			configp->burst_post_ms = BURST_DEFAULT_WINDOW_MS;
+			if (sscanf(optarg, "%d,%d,%d", &configp->burst_us,
+				   &configp->burst_pre_ms,
+				   &configp->burst_post_ms) == 2 ||
+			    configp->burst_us < BURST_MIN_US ||
+			    configp->burst_pre_ms < 0 ||
+			    configp->burst_post_ms < 0) {
+				printf("--burst expects us[,pre_ms,post_ms] with us >= %d\n",
+							BURST_MIN_US);
+				return 0;
+			}
+			break;
+		case OPT_EVENTS:
+			if (!strcmp(optarg, "log")) {
+				configp->events = EVENTS_LOG;
+			} else if (!strcmp(optarg, "trace")) {
+				configp->events = EVENTS_TRACE;
+			} else {
+				printf("--events expects log or trace\n");
+				return 0;
+			}
+			break;
+		case OPT_TRACE_FREQ:
+			configp->trace_freq = 1;
+			break;
+		case OPT_OS_STATS:
+			configp->os_stats = 1;
+			break;
+		case OPT_IDLE_SKIP:
+			configp->idle_skip = 1;
+			break;
+		case OPT_OPS:
+			configp->ops = 1;
+			break;
+		case OPT_HW_ROOT:
+			len = sizeof(configp->hw_root);
+			strncpy(configp->hw_root, optarg, len);
+			configp->hw_root[len - 1] = '\0';
+			break;
+		case OPT_COL_PERIOD:
+			if (configp->nr_col_periods == MAX_THRESHOLDS) {
+				printf("max %d --col-period\n", MAX_THRESHOLDS);
+				return 0;
+			}
+			if (sscanf(optarg, "%31[^=]=%d",
+				   configp->period_col[configp->nr_col_periods],
+				   &configp->period_ms[configp->nr_col_periods]) != 2 ||
+			    configp->period_ms[configp->nr_col_periods] <= 0) {
+				printf("--col-period expects column=ms\n");
+				return 0;
+			}
+			configp->nr_col_periods++;
+			break;
+		case OPT_DERIVE:
+			if (configp->nr_derive == MAX_DERIVE) {
+				printf("max %d --derive\n", MAX_DERIVE);
+				return 0;
+			}
+			len = sizeof(configp->derive[0]);
+			strncpy(configp->derive[configp->nr_derive], optarg, len);
+			configp->derive[configp->nr_derive++][len - 1] = '\0';
+			break;
+		case OPT_ADAPTIVE_POLL:
+			if (sscanf(optarg, "%d,%d", &configp->adapt_floor_ms,
+				   &configp->adapt_ceil_ms) != 2 ||
+			    configp->adapt_floor_ms < 1 ||
+			    configp->adapt_ceil_ms < configp->adapt_floor_ms) {
+				printf("--adaptive-poll expects floor,ceiling (ms), 1 <= floor <= ceiling\n");
+				return 0;
+			}
+			break;
+		case OPT_TRIGGER:
+			if (configp->nr_triggers == MAX_TRIGGERS) {
+				printf("max %d --trigger\n", MAX_TRIGGERS);
+				return 0;
+			}
+			len = sizeof(configp->trigger[0]);
+			strncpy(configp->trigger[configp->nr_triggers], optarg,
+									len);
+			configp->trigger[configp->nr_triggers++][len - 1] = '\0';
+			break;
 		case 'h':
 		case '?':
 		default:
@@ -315,6 +670,12 @@ int parse_cmd_config(int ac, char **av, struct config *configp)
 		} /* switch */
 	} /* while */
 
+	/* segments to keep only exist once the log rolls over */
+	if (configp->rotate_keep && !log_rotate_enabled(configp)) {
+		printf("--rotate-keep needs --rotate-size or --rotate-time\n");
+		return 0;
+	}
+
 	if (optind < ac) {
 		print_usage("psst");
 		return 0;
@@ -347,8 +708,74 @@ static void verbose_prints(struct config *configp)
 
 	printf("\n");
 	printf("poll period %dms\n", configp->poll_period);
-	printf("run duration %dms\n", configp->duration);
+	for (i = 0; i < configp->nr_derive; i++)
+		printf("Derived column %s\n", configp->derive[i]);
+	if (configp->adapt_floor_ms)
+		printf("Adaptive poll period: %d..%dms\n",
+			configp->adapt_floor_ms, configp->adapt_ceil_ms);
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (col_desc[i].report_enabled && col_desc[i].period_ms)
+			printf("%s read every %dms\n", col_desc[i].header_name,
+						col_desc[i].period_ms);
+	}
+	printf("run duration %lldms\n", configp->duration);
 	printf("Log file path: %s\n", configp->log_file_name);
+	if (log_rotate_enabled(configp))
+		printf("Log rotation: %lld MB, %d sec, keep %d segments\n",
+				configp->rotate_size / (1024 * 1024),
+				configp->rotate_time, configp->rotate_keep);
+	if (configp->shm_name[0])
+		printf("Live snapshot: /dev/shm/%s\n", configp->shm_name);
+	if (configp->metrics_addr[0])
+		printf("OpenMetrics exporter: %s%s\n",
+			configp->metrics_addr[0] == '/' ? "" : "127.0.0.1:",
+			configp->metrics_addr);
+	for (i = 0; i < configp->nr_rollups; i++)
+		printf("Rollup window: %dms\n", configp->rollup_ms[i]);
+	if (configp->no_raw)
+		printf("Per-sample records not logged (--no-raw)\n");
+	if (configp->summary_file[0])
+		printf("Run summary: %s\n", configp->summary_file);
+	if (configp->sampler_cpu >= 0)
+		printf("Sampler thread on cpu%d\n", configp->sampler_cpu);
+	if (configp->self_stats)
+		printf("Self overhead columns & report enabled\n");
+	printf("ON window phase: %s\n", configp->phase == PHASE_STAGGER ?
+			"stagger" : configp->phase == PHASE_RANDOM ?
+			"random" : "in");
+	printf("scheduling class: %s\n",
+		configp->sched_policy == SCHED_FIFO ? "fifo" :
+		configp->sched_policy == SCHED_RR ? "rr" :
+		configp->sched_policy == SCHED_DEADLINE ? "deadline" : "other");
+	if (configp->control_path[0])
+		printf("Control socket: %s\n", configp->control_path);
+	if (configp->scenario_file[0])
+		printf("Scenario: %s\n", configp->scenario_file);
+	if (configp->sweep)
+		printf("Sweep: load %.1f to %.1f step %.1f\n",
+			configp->sweep_from, configp->sweep_to,
+			configp->sweep_step);
+	if (configp->step_period_ms)
+		printf("Step response: %.1f <-> %.1f every %dms\n",
+			configp->step_low, configp->step_high,
+			configp->step_period_ms);
+	if (configp->burst_us)
+		printf("Burst capture every %dus, %dms before/%dms after %d trigger(s)\n",
+			configp->burst_us, configp->burst_pre_ms,
+			configp->burst_post_ms, configp->nr_triggers);
+	if (configp->events)
+		printf("Events: duty cycle marks%s\n",
+			configp->events == EVENTS_TRACE ? ", trace_marker" : "");
+	if (configp->trace_freq)
+		printf("Power tracepoints: TrFreq/TrIdle columns, timeline\n");
+	if (configp->os_stats)
+		printf("cpufreq/cpuidle sysfs columns per cpu\n");
+	if (configp->ops)
+		printf("Work accounting: ops/s & ops/J columns\n");
+	if (configp->hw_root[0])
+		printf("Hardware files under %s\n", configp->hw_root);
+	if (configp->idle_skip)
+		printf("Idle cpus not woken for MSR reads\n");
 	printf("power curve shape: %s\n", configp->shape_func);
 	printf("\n");
 }
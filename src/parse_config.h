@@ -27,7 +27,16 @@
 #include "psst.h"
 #include "logger.h"
 
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
 #define MAX_LEN 512
+#define MAX_ROLLUPS 8
+#define MAX_THRESHOLDS 16
+#define MAX_SWEEP_CORES 16
+#define MAX_TRIGGERS 8
+#define MAX_DERIVE 16
 #define BASE_PATH_RAPL \
 	"/sys/devices/virtual/powercap/intel-rapl/intel-rapl"
 #define BASE_PATH_TZONE "/sys/devices/virtual/thermal/thermal_zone"
@@ -57,9 +66,56 @@ struct config {
 	int log_file_fd;
 	char shape_func[20];
 	int poll_period;
-	int duration;
+	long long duration;
+	long long rotate_size;
+	int rotate_time;
+	int rotate_keep;
+	char shm_name[64];
+	char metrics_addr[100];
+	int rollup_ms[MAX_ROLLUPS];
+	int nr_rollups;
+	int no_raw;
+	char summary_file[128];
+	char above_col[MAX_THRESHOLDS][32];
+	double above_val[MAX_THRESHOLDS];
+	int nr_above;
+	int sampler_cpu;
+	int self_stats;
+	int phase;
+	int sched_policy;	/* SCHED_OTHER, _FIFO, _RR or _DEADLINE */
+	char control_path[100];
+	char scenario_file[128];
+	int sweep;
+	float sweep_from, sweep_to, sweep_step;
+	int sweep_cores[MAX_SWEEP_CORES];
+	int nr_sweep_cores;
+	float step_low, step_high;
+	int step_period_ms;	/* 0: no --step-response */
+	int step_edges;
+	int burst_us;		/* 0: no --burst */
+	int burst_pre_ms, burst_post_ms;
+	char trigger[MAX_TRIGGERS][32];
+	int nr_triggers;
+	int events;		/* EVENTS_OFF, _LOG or _TRACE */
+	int trace_freq;
+	int os_stats;
+	int idle_skip;
+	char period_col[MAX_THRESHOLDS][32];
+	int period_ms[MAX_THRESHOLDS];
+	int nr_col_periods;
+	int adapt_floor_ms, adapt_ceil_ms;	/* 0: fixed poll period */
+	char derive[MAX_DERIVE][128];
+	int nr_derive;
+	int ops;
+	char hw_root[100];	/* --hw-root, "": files under / */
 };
 
+/* --phase: where each worker's ON window sits in the tick */
+enum phase_mode { PHASE_IN, PHASE_STAGGER, PHASE_RANDOM };
+
+/* --events: duty cycle change marks, and marks to tracefs too */
+enum events_mode { EVENTS_OFF, EVENTS_LOG, EVENTS_TRACE };
+
 extern int dont_stress_cpu0;
 typedef enum cpu_stress_option { UNDEFINED,
 				 WELL_DEFINED } cpu_stress_opt_t;
@@ -67,6 +123,7 @@ extern cpu_stress_opt_t cpu_stress_opt;
 extern int parse_cmd_config(int ac, char **av, struct config *configp);
 extern int populate_default_config(struct config *configp);
 extern int parse_power_shape(char *shape, data_t *pst);
+extern int cpuset_to_bitmap(char *buf, cpu_set_t *cpumask);
 extern int avail_freq_item(int item);
 
 #endif
@@ -18,9 +18,11 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "parse_config.h"
 #include "perf_msr.h"
 
 int read_msr(int fd, uint32_t reg, uint64_t *data)
@@ -39,7 +41,8 @@ int initialize_dev_msr(int c)
 	int fd;
 	char msr_file[128];
 
-	sprintf(msr_file, "/dev/cpu/%d/msr", c);
+	snprintf(msr_file, sizeof(msr_file), "%s/dev/cpu/%d/msr",
+						configpv.hw_root, c);
 	fd = open(msr_file, O_RDONLY);
 	if (fd < 0) {
 		perror("rdmsr: open");
@@ -75,22 +78,62 @@ uint64_t get_diff_##scope(uint64_t cur_value)			       \
 	return diff;					       \
 }
 
-uint64_t *last_aperf = NULL;
-uint64_t *last_mperf = NULL;
-uint64_t *last_pperf = NULL;
-uint64_t *last_tsc = NULL;
+/*
+ * Per-cpu counter state is kept as one array per field, indexed by
+ * thread#, rather than an array of per-cpu structs. Each sample then runs
+ * a few flat, branch free loops over contiguous data that the compiler
+ * vectorizes, instead of striding through mixed structs. Everything here
+ * is only touched by the sampling context.
+ */
+perf_diffs_t perf_diffs;
+static uint64_t *cur_aperf, *cur_mperf, *cur_pperf, *cur_tsc;
+static uint64_t *last_aperf, *last_mperf, *last_pperf, *last_tsc;
+
+static void *alloc_cpu_array(int n, size_t sz)
+{
+	void *p;
+	size_t len = (n * sz + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+
+	/* own cache lines, aligned for vector loads */
+	if (posix_memalign(&p, CACHE_LINE_SIZE, len))
+		return NULL;
+	memset(p, 0, len);
+	return p;
+}
 
 int init_delta_vars(int n)
 {
-	last_aperf = malloc(sizeof(uint64_t) * n);
-	last_mperf = malloc(sizeof(uint64_t) * n);
-	last_pperf = malloc(sizeof(uint64_t) * n);
-	last_tsc = malloc(sizeof(uint64_t) * n);
-	if (!last_aperf || !last_mperf || !last_mperf || !last_tsc) {
-		printf("malloc failure perf vars\n");
-		return 0;
+	uint64_t **u[] = {&cur_aperf, &cur_mperf, &cur_pperf, &cur_tsc,
+			  &last_aperf, &last_mperf, &last_pperf, &last_tsc,
+			  &perf_diffs.aperf, &perf_diffs.mperf,
+			  &perf_diffs.pperf, &perf_diffs.tsc};
+	float **f[] = {&perf_diffs.load, &perf_diffs.freq,
+		       &perf_diffs.scale, &perf_diffs.nperf};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(u) / sizeof(u[0]); i++) {
+		*u[i] = alloc_cpu_array(n, sizeof(uint64_t));
+		if (!*u[i])
+			goto fail;
+	}
+	for (i = 0; i < sizeof(f) / sizeof(f[0]); i++) {
+		*f[i] = alloc_cpu_array(n, sizeof(float));
+		if (!*f[i])
+			goto fail;
 	}
 	return 1;
+fail:
+	printf("malloc failure perf vars\n");
+	return 0;
+}
+
+/* latest raw counters of thread t. a failed read repeats the last value */
+void read_perf_msrs(int t, int fd)
+{
+	read_msr(fd, (uint32_t)MSR_IA32_PPERF, &cur_pperf[t]);
+	read_msr(fd, (uint32_t)MSR_IA32_APERF, &cur_aperf[t]);
+	read_msr(fd, (uint32_t)MSR_IA32_MPERF, &cur_mperf[t]);
+	read_msr(fd, (uint32_t)MSR_IA32_TSC, &cur_tsc[t]);
 }
 
 /*
@@ -103,19 +146,99 @@ int init_delta_vars(int n)
 			(uint64_t)((uint32_t)~0UL - (uint32_t)a + (uint32_t)b) :\
 			((uint64_t)b - (uint64_t)a))
 
-/* routine to evaluate & store a per-cpu msr value's diff */
-#define VARI(a, b, i) a##b[i]
-#define cpu_generate_msr_diff(scope)					       \
-uint64_t cpu_get_diff_##scope(uint64_t cur_value, int instance)		       \
-{									       \
-	uint64_t diff;							       \
-	diff = (VARI(last_, scope, instance) == 0) ?			       \
-			0 : u64diff(cur_value, VARI(last_, scope, instance));  \
-	VARI(last_, scope, instance) = cur_value;			       \
-	return diff;					       		       \
+/*
+ * The kernel below is written branch free so it vectorizes (built with
+ * -O3, see Makefile). 64 bit unsigned compares need avx2, so on x86 an
+ * avx2 clone is picked at load time when the cpu has it.
+ */
+#if defined(__x86_64__) && defined(__GLIBC__)
+#define VECTOR_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define VECTOR_KERNEL
+#endif
+
+/*
+ * exact for x < 2^52 (> 2 weeks of tsc ticks) and, unlike a plain cast,
+ * done with integer & double vector ops that every x86_64 has.
+ */
+static inline double u64_to_double(uint64_t x)
+{
+	union { uint64_t u; double d; } v;
+
+	v.u = x | 0x4330000000000000ULL;	/* 2^52 + x */
+	return v.d - 4503599627370496.0;
 }
 
-cpu_generate_msr_diff(aperf);
-cpu_generate_msr_diff(mperf);
-cpu_generate_msr_diff(pperf);
-cpu_generate_msr_diff(tsc);
+/* num / den, or 0 when the integer counter behind den is 0, branch free */
+#define SAFE_DIV(num, den, den_raw) ({				\
+	double __nz = (den_raw) != 0;				\
+	__nz * (num) / ((den) + 1 - __nz); })
+
+/*
+ * One pass over every cpu: diff = cur - last (0 on the first reading),
+ * last = cur for each counter, then load, frequency, scale factor and
+ * normalized perf from the diffs. A zero denominator gives 0 rather than
+ * nan/inf.
+ *
+ * Normalized perf is pperf per load per time (see
+ * github.com/intel/psst >whitepapers >Generic_perf_per_watt.pdf):
+ * (pperf / poll_us) / (mperf / tsc) with poll_us = tsc / hfm_mhz, which
+ * is pperf * hfm_mhz / mperf.
+ */
+#define DIFF(d, cur, last, i) ({				\
+	uint64_t __c = cur[i], __l = last[i];			\
+	uint64_t __d = u64diff(__c, __l) & -(uint64_t)(__l != 0);	\
+	last[i] = __c;						\
+	d[i] = __d; })
+
+VECTOR_KERNEL
+static void perf_kernel(int n)
+{
+	uint64_t *restrict a = perf_diffs.aperf;
+	uint64_t *restrict m = perf_diffs.mperf;
+	uint64_t *restrict p = perf_diffs.pperf;
+	uint64_t *restrict t = perf_diffs.tsc;
+	const uint64_t *restrict ca = cur_aperf, *restrict cm = cur_mperf;
+	const uint64_t *restrict cp = cur_pperf, *restrict ct = cur_tsc;
+	uint64_t *restrict la = last_aperf, *restrict lm = last_mperf;
+	uint64_t *restrict lp = last_pperf, *restrict lt = last_tsc;
+	float *restrict load = perf_diffs.load;
+	float *restrict freq = perf_diffs.freq;
+	float *restrict scale = perf_diffs.scale;
+	float *restrict nperf = perf_diffs.nperf;
+	double hfm = cpu_hfm_mhz;
+	uint64_t da, dm, dp, dt;
+	double fa, fm, fp, ft;
+	int i;
+
+	/* arrays are distinct: too many for gcc to version the loop on */
+#pragma GCC ivdep
+	for (i = 0; i < n; i++) {
+		da = DIFF(a, ca, la, i);
+		dm = DIFF(m, cm, lm, i);
+		dp = DIFF(p, cp, lp, i);
+		dt = DIFF(t, ct, lt, i);
+		fa = u64_to_double(da);
+		fm = u64_to_double(dm);
+		fp = u64_to_double(dp);
+		ft = u64_to_double(dt);
+		load[i] = SAFE_DIV(fm * 100, ft, dt);
+		scale[i] = SAFE_DIV(fp * 100, fa, da);
+		freq[i] = SAFE_DIV(fa * hfm, fm, dm);
+		nperf[i] = SAFE_DIV(fp * hfm, fm, dm);
+	}
+}
+
+/* diff all counters read since the last call, derive metrics */
+float compute_perf_diffs(int n)
+{
+	int i;
+	double sum_nperf = 0;
+
+	perf_kernel(n);
+
+	/* in order double sum: not vectorized, kept out of the kernel */
+	for (i = 0; i < n; i++)
+		sum_nperf += perf_diffs.nperf[i];
+	return sum_nperf;
+}
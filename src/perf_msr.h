@@ -26,13 +26,24 @@
 #define MSR_PLATFORM_INFO	0xce
 #define MSR_PERF_STATUS		0x198
 
+/*
+ * per-cpu counter diffs since the previous sample & metrics derived from
+ * them, one array per field indexed by thread#. see perf_msr.c
+ */
+typedef struct {
+	uint64_t *aperf, *mperf, *pperf, *tsc;
+	float *load;	/* C0 residency [%] */
+	float *freq;	/* average C0 frequency [MHz] */
+	float *scale;	/* pperf/aperf [%] */
+	float *nperf;	/* normalized perf [perf/uS] */
+} perf_diffs_t;
+
+extern perf_diffs_t perf_diffs;
 extern int cpu_hfm_mhz;
 extern int read_msr(int fd, uint32_t reg, uint64_t *data);
 extern int initialize_dev_msr(int c);
 extern int initialize_cpu_hfm_mhz(int fd);
 extern int init_delta_vars(int n);
-extern uint64_t cpu_get_diff_aperf(uint64_t a, int i);
-extern uint64_t cpu_get_diff_mperf(uint64_t m, int i);
-extern uint64_t cpu_get_diff_pperf(uint64_t p, int i);
-extern uint64_t cpu_get_diff_tsc(uint64_t t, int i);
+extern void read_perf_msrs(int t, int fd);
+extern float compute_perf_diffs(int n);
 #endif
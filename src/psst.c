@@ -31,12 +31,33 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <sched.h>
 
 #include "parse_config.h"
 #include "psst.h"
 #include "logger.h"
 #include "rapl.h"
 #include "perf_msr.h"
+#include "shm_export.h"
+#include "metrics.h"
+#include "rollup.h"
+#include "summary.h"
+#include "sampler.h"
+#include "selfstat.h"
+#include "control.h"
+#include "scenario.h"
+#include "sweep.h"
+#include "step.h"
+#include "burst.h"
+#include "trace_freq.h"
+#include "os_stats.h"
+#include "idle_skip.h"
+#include "adaptive.h"
+#include "derive.h"
+#include "work.h"
+#include "fallback.h"
 
 
 void print_version(void)
@@ -51,10 +72,9 @@ int nr_threads;
  * However, the motive of this tool is reasonable peak power & its
  * controllabilty. both motives are met using meaningful work.
  */
-static void cpu_work(int on_time_us)
+static void cpu_work(data_t *data)
 {
-	(void)on_time_us; /* please the compiler */
-	return;
+	work_unit(data);
 }
 
 int ts_compare(struct timespec *time1, struct timespec *time2)
@@ -89,9 +109,16 @@ int is_time_remaining(clockid_t clk, struct timespec *ts_last,
 		return 0;
 }
 
-int timespec_to_msec(struct timespec *t)
+void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+long long timespec_to_msec(struct timespec *t)
 {
-	return t->tv_sec*1000 + t->tv_nsec/1000000;
+	return (long long)t->tv_sec*1000 + t->tv_nsec/1000000;
 }
 unsigned long clockdiff_now_ns(clockid_t clk,  struct timespec *ts_then)
 {
@@ -112,21 +139,65 @@ int set_affinity(int pr)
 	return 0;
 }
 
+/*
+ * max or min priority of the --sched policy. deadline reservations are
+ * per worker (set_deadline()); everything else in that mode runs fifo.
+ */
 int set_sched_priority(int min_max)
 {
-	int policy;
+	int policy, ret;
 	struct sched_param param;
 
 	pthread_getschedparam(pthread_self(), &policy, &param);
+	policy = configpv.sched_policy;
+	if (policy == SCHED_DEADLINE)
+		policy = SCHED_FIFO;
 	if (min_max)
 		param.sched_priority = sched_get_priority_max(policy);
 	else
 		param.sched_priority = sched_get_priority_min(policy);
 
-	pthread_setschedparam(pthread_self(), policy, &param);
+	ret = pthread_setschedparam(pthread_self(), policy, &param);
+	if (ret)
+		printf("sched policy %d prio %d: %s\n", policy,
+				param.sched_priority, strerror(ret));
 	return 0;
 }
 
+/* not in older libc headers */
+struct psst_sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+/* runtime_ns of cpu guaranteed, and enforced, every period_ns */
+static int set_deadline(uint64_t runtime_ns, uint64_t period_ns)
+{
+#ifdef SYS_sched_setattr
+	struct psst_sched_attr attr = {
+		.size = sizeof(attr),
+		.sched_policy = SCHED_DEADLINE,
+		.sched_runtime = runtime_ns,
+		.sched_deadline = period_ns,
+		.sched_period = period_ns,
+	};
+
+	/* kernel minimum is 1us */
+	if (attr.sched_runtime < 1024)
+		attr.sched_runtime = 1024;
+	return syscall(SYS_sched_setattr, 0, &attr, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 int cap_v_unit(float *v_unitp, float max, float min)
 {
 	if (*v_unitp >= (float)max) {
@@ -221,17 +292,103 @@ int power_shaping(ps_t *ps, float *v_unit)
 
 }
 
+/*
+ * --trigger shape: the edges of stepwise shapes count as a new shape.
+ * Ramps and sine waves move every PS_MIN_POLL_MS and would fire always.
+ */
+#define SHAPE_EDGE_MIN (0.01)
+static void note_shape_edge(ps_t *ps, float from, float to)
+{
+	if ((ps->psn == SINGLE_PULSE || ps->psn == STAIR_CASE) &&
+	    fabsf(to - from) >= SHAPE_EDGE_MIN)
+		burst_note_shape();
+}
+
+/*
+ * --sched deadline: the kernel runs this worker for on_time in every tick
+ * and throttles it for the rest, so there is no ON/OFF clock polling. The
+ * reservation is re-programmed when the shape changes the duty cycle.
+ */
+static void work_deadline(ps_t *ps, data_t *data_ptr, float duty_cycle,
+			  int pr, int tick_usec)
+{
+	int on_time_us = tick_usec * duty_cycle / 100;
+	int dl_on_us = on_time_us;
+	unsigned int ctl_seen = 0;
+	int parked = 0;
+	int mark_duty = !(pr == 0 && dont_stress_cpu0);
+	float duty_logged = duty_cycle;
+
+	while (!exit_cpu_thread) {
+		/* a picked up shape is applied by power_shaping() below */
+		control_pick_up(data_ptr, &ctl_seen, ps, &parked);
+		if (parked) {
+			data_ptr->duty_cycle = 0;
+			if (mark_duty)
+				control_event_duty(pr, &duty_logged, 0);
+			usleep(tick_usec);
+			continue;
+		}
+		data_ptr->duty_cycle = duty_cycle;
+		if (power_shaping(ps, &duty_cycle))
+			on_time_us = tick_usec * duty_cycle / 100;
+		note_shape_edge(ps, data_ptr->duty_cycle, duty_cycle);
+		if (mark_duty)
+			control_event_duty(pr, &duty_logged, duty_cycle);
+		if (on_time_us != dl_on_us) {
+			if (set_deadline((uint64_t)on_time_us * 1000,
+					 (uint64_t)tick_usec * 1000))
+				printf("cpu%d deadline %dus/%dus: %s\n", pr,
+					on_time_us, tick_usec, strerror(errno));
+			dl_on_us = on_time_us;
+		}
+		if (mark_duty)
+			cpu_work(data_ptr);
+		if (pr == 0 && configpv.sampler_cpu < 0)
+			do_logging(duty_cycle);
+	}
+}
+
 #define START_DELAY 0
+/* epoch is set this far ahead so no thread has missed its first tick */
+#define START_EPOCH_LEAD_NS (2 * 1000000)
+
+static pthread_barrier_t start_barrier;
+static struct timespec start_epoch;
+
+/*
+ * Every worker (and the sampler thread) waits here once set up, so
+ * thread creation latency does not skew them. The last one to arrive
+ * fixes the epoch that shapes, ON windows and the Time column count from.
+ */
+void wait_start_epoch(struct timespec *epoch)
+{
+	if (pthread_barrier_wait(&start_barrier) ==
+				PTHREAD_BARRIER_SERIAL_THREAD) {
+		if (clock_gettime(CLOCK_MONOTONIC, &start_epoch))
+			perror("clock_gettime");
+		timespec_add_ns(&start_epoch, START_EPOCH_LEAD_NS);
+	}
+	pthread_barrier_wait(&start_barrier);
+	*epoch = start_epoch;
+}
 
 static void work_fn(void *data)
 {
 	int start_pending = 0;
 	int tick_usec = DEFAULT_TICK_USEC;
-	int ret, on_time_us, off_time_us, pr;
+	int ret, on_time_us, pr;
 	int cpu_work_exist = 0;
-	float duty_cycle, dummy;
-	struct timespec ts;
-	static int start_ms;
+	int on_ns;
+	unsigned int ctl_seen = 0;
+	int parked = 0;
+	int mark_duty;
+	long long sampler_debt_ns = 0;
+	uint64_t sampler_ns_seen = 0, sampler_ns;
+	float duty_cycle, duty_logged = 0;
+	struct timespec ts, epoch, next_tick, sched;
+	long long start_ms, time_ms;
+	float soc_r_avg, pp0_r_avg;
 	data_t *data_ptr = (data_t*)data;
 	ps_t ps;
 
@@ -263,42 +420,81 @@ static void work_fn(void *data)
 	duty_cycle = (fabsf(duty_cycle - MIN_LOAD) < MIN_LOAD/10) ? MIN_LOAD : duty_cycle;
 
 	if (pr == 0) {
-		plog_poll_sec = MSEC_TO_SEC(configpv.poll_period);
-		plog_poll_nsec = (plog_poll_sec > 0) ?
-					REMAINING_MS_TO_NS(configpv.poll_period) :
-					configpv.poll_period * 1000000;
-
-		duration_sec = MSEC_TO_SEC(configpv.duration);
-		duration_nsec = (duration_sec > 0) ?
-				REMAINING_MS_TO_NS(configpv.duration) :
-				configpv.duration * 1000000;
-		dbg_print("thread %d sec: %d nsec %d\n",
-				pr, duration_sec, duration_nsec);
-		initialize_log_clock();
-		update_perf_diffs(&dummy);
 		if (dont_stress_cpu0) {
 			duty_cycle = MIN_LOAD;
 			ps.psn = NONE;
 		}
 	}
-	/* initial on/off time calculation based on duty cycle */
+	/* --events: duty cycle marks for cpus that do work */
+	mark_duty = cpu_work_exist && !(pr == 0 && dont_stress_cpu0);
+	duty_logged = duty_cycle;
+	/* initial on time calculation based on duty cycle. off is the rest */
 	on_time_us = (tick_usec * duty_cycle / 100);
-	off_time_us = tick_usec - on_time_us;
-	dbg_print("Thread:%x DutyCycle:%f ontime:%duS, idletime:%duS\n",
+	dbg_print("Thread:%x DutyCycle:%f ontime:%duS, tick:%duS\n",
 			(unsigned int)pthread_self(),
-			duty_cycle, on_time_us, off_time_us);
-
-	/* monotonic clock initial reference. updated during power_shaping */
-	if (clock_gettime(CLOCK_MONOTONIC, &ps.last))
-		perror("clock_gettime 1");
-
-	start_ms = timespec_to_msec(&ps.last);
+			duty_cycle, on_time_us, tick_usec);
+
+	wait_start_epoch(&epoch);
+	/* with --sampler-cpu, the sampler thread owns sampling */
+	if (pr == 0 && configpv.sampler_cpu < 0)
+		initialize_sampling(&epoch);
+
+	/* shapes count from the common epoch. updated during power_shaping */
+	ps.last = epoch;
+	ps.begin = epoch;
+	start_ms = timespec_to_msec(&epoch);
+
+	/* ON windows start on a tick grid, shifted by this worker's phase */
+	next_tick = epoch;
+	timespec_add_ns(&next_tick, (uint64_t)data_ptr->phase_us * 1000);
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
+
+	if (configpv.sched_policy == SCHED_DEADLINE && cpu_work_exist) {
+		if (!set_deadline((uint64_t)on_time_us * 1000,
+				  (uint64_t)tick_usec * 1000)) {
+			work_deadline(&ps, data_ptr, duty_cycle, pr, tick_usec);
+			goto report;
+		}
+		/*
+		 * EPERM: pinned tasks are refused unless their cpu is a root
+		 * domain of its own (exclusive cpuset) or admission control
+		 * is off (kernel.sched_rt_runtime_us = -1). EBUSY: bandwidth.
+		 */
+		printf("cpu%d SCHED_DEADLINE: %s. using fifo\n", pr,
+						strerror(errno));
+	}
 
 	do {
+		/* --control changes land on a tick boundary */
+		if (control_pick_up(data_ptr, &ctl_seen, &ps, &parked)) {
+			if (!parked)
+				power_shaping(&ps, &duty_cycle);
+			data_ptr->duty_cycle = parked ? 0 : duty_cycle;
+			on_time_us = parked ? 0 : tick_usec * duty_cycle / 100;
+			if (mark_duty)
+				control_event_duty(pr, &duty_logged,
+						   data_ptr->duty_cycle);
+		}
+		on_ns = on_time_us * 1000;
+		if (pr == configpv.sampler_cpu && cpu_work_exist) {
+			/* sampler time spent on this core is part of its load */
+			sampler_ns = __atomic_load_n(&sampler_cpu_ns,
+							__ATOMIC_RELAXED);
+			sampler_debt_ns += sampler_ns - sampler_ns_seen;
+			sampler_ns_seen = sampler_ns;
+			if (sampler_debt_ns > on_ns) {
+				sampler_debt_ns -= on_ns;
+				on_ns = 0;
+			} else {
+				on_ns -= sampler_debt_ns;
+				sampler_debt_ns = 0;
+			}
+		}
+
 		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
 			perror("clock_gettime 2");
 		while (is_time_remaining(CLOCK_THREAD_CPUTIME_ID, &ts, 0,
-							on_time_us*1000)) {
+							on_ns)) {
 			if (timespec_to_msec(&ps.last) - start_ms < START_DELAY) {
 				if (clock_gettime(CLOCK_MONOTONIC, &ps.last))
 					perror("clock_gettime 3");
@@ -313,20 +509,24 @@ static void work_fn(void *data)
 				 * it will be accounted for good.
 				 */
 				data_ptr->duty_cycle = duty_cycle;
-				if (power_shaping(&ps, &duty_cycle)) {
+				if (power_shaping(&ps, &duty_cycle))
 					on_time_us = tick_usec * duty_cycle/100;
-					off_time_us = tick_usec - on_time_us;
-				}
+				note_shape_edge(&ps, data_ptr->duty_cycle,
+							duty_cycle);
+				if (mark_duty)
+					control_event_duty(pr, &duty_logged,
+							   duty_cycle);
 			}
 
 			if (!start_pending) {
 				/* No work for cpu0 if it was just submitter */
-				if ((dont_stress_cpu0 || (pr != 0)) && cpu_work_exist) {
-					cpu_work(on_time_us);
+				if (!(pr == 0 && dont_stress_cpu0) &&
+				    cpu_work_exist) {
+					cpu_work(data_ptr);
 				}
 			}
 
-			if (pr == 0) {
+			if (pr == 0 && configpv.sampler_cpu < 0) {
 				do_logging(duty_cycle);
 				/* XXX: gfx, mem work */
 			}
@@ -334,24 +534,39 @@ static void work_fn(void *data)
 
 		if (exit_cpu_thread)
 			continue;
-		/* now for OFF cycle */
-		ts.tv_sec = 0;
-		ts.tv_nsec = off_time_us * 1000;
-		nanosleep(&ts, NULL);
+		/*
+		 * now for OFF cycle: idle until the next tick. an ON window
+		 * that overran it (100% load, preemption) has no OFF time:
+		 * the next one starts right away and next_tick goes back on
+		 * the grid at the last tick passed, so the one after that
+		 * ends on the grid again. no tick is slept through.
+		 */
+		timespec_add_ns(&next_tick, (uint64_t)tick_usec * 1000);
+		if (clock_gettime(CLOCK_MONOTONIC, &ts))
+			perror("clock_gettime 4");
+		if (ts_compare(&next_tick, &ts) > 0) {
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+							&next_tick, NULL);
+			continue;
+		}
+		sched = next_tick;
+		timespec_add_ns(&sched, (uint64_t)tick_usec * 1000);
+		while (ts_compare(&sched, &ts) <= 0) {
+			next_tick = sched;
+			timespec_add_ns(&sched, (uint64_t)tick_usec * 1000);
+		}
 	} while(!exit_cpu_thread && cpu_work_exist);
 
+report:
 	/* report out energy index details before exit */
-	int N;
-	int time_ms;
-	float soc_r_avg, pp0_r_avg;
 	if (clock_gettime(CLOCK_MONOTONIC, &ts))
 		perror("clock_gettime 1");
 	time_ms = timespec_to_msec(&ts) - start_ms;
-	N = (int)time_ms/configpv.poll_period;
 
 	if (pr == 0) {
-		printf("\nDuration: %d ms. poll: %d ms. samples: %d\n",
-					    time_ms, configpv.poll_period, N);
+		printf("\nDuration: %lld ms. poll: %d ms. samples: %llu\n",
+			time_ms, configpv.poll_period,
+			__atomic_load_n(&log_samples, __ATOMIC_RELAXED));
 		if (rapl_pp0_supported) {
 			soc_r_avg = (float)(soc_diff_uj[0])/(time_ms*1000);
 			pp0_r_avg = (float)(pp0_diff_uj)/(time_ms*1000);
@@ -393,7 +608,7 @@ perf_stats_t *perf_stats;
 
 int main(int argc, char *argv[])
 {
-	int c, t = 0, ret;
+	int c, i, t = 0, ret, msr_ok;
 	float duty;
 	void *res;
 	data_t *pst;
@@ -422,7 +637,9 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	pthread_t io_thread;
+	pthread_t io_thread, metrics_thread, sampler_thread, control_thread;
+	pthread_t burst_thread;
+	int metrics_started = 0, control_started = 0, burst_started = 0;
 	pthread_attr_t attr_io;
 	if (pthread_attr_init(&attr_io)) {
 		perror("io thread attr");
@@ -455,8 +672,8 @@ int main(int argc, char *argv[])
 		perror("malloc thread_ptr");
 		goto bail;
 	}
-	data_ptr = malloc(sizeof(data_t) * nr_threads);
-	if (!data_ptr) {
+	if (posix_memalign((void **)&data_ptr, CACHE_LINE_SIZE,
+					sizeof(data_t) * nr_threads)) {
 		perror("malloc data_ptr");
 		goto bail;
 	}
@@ -466,23 +683,103 @@ int main(int argc, char *argv[])
 		goto bail;
 	}
 
+	msr_ok = 1;
 	for (c = 0, t = 0; c < CPU_SETSIZE && t < nr_threads; c++) {
 		if (!CPU_ISSET(c, &cfg->cpumask))
 			continue;
-		ret = initialize_dev_msr(c);
-		if (ret < 0) {
-			perf_stats[t].dev_msr_supported = 0;
+		perf_stats[t].cpu = c;
+		ret = msr_ok ? initialize_dev_msr(c) : -1;
+		if (ret < 0 && msr_ok) {
 			printf("*** No /dev/cpu%d/msr. check CONFIG_X86_MSR support ***\n\n", c);
-			break;
-		} else {
-			perf_stats[t].cpu = c;
-			perf_stats[t].dev_msr_fd = ret;
-			perf_stats[t].dev_msr_supported = 1;
+			msr_ok = 0;
 		}
+		perf_stats[t].dev_msr_fd = ret;
 		t++;
 	}
-	if (initialize_cpu_hfm_mhz(perf_stats[0].dev_msr_fd))
+	/* all or nothing: a cpu without msr puts every cpu on the fallback */
+	for (t = 0; t < nr_threads; t++) {
+		if (!msr_ok && perf_stats[t].dev_msr_fd >= 0) {
+			close(perf_stats[t].dev_msr_fd);
+			perf_stats[t].dev_msr_fd = -1;
+		}
+		perf_stats[t].dev_msr_supported = msr_ok;
+	}
+	if (msr_ok && initialize_cpu_hfm_mhz(perf_stats[0].dev_msr_fd))
+		goto bail;
+	if (!initialize_fallback(cfg, msr_ok))
+		goto bail;
+	if (!initialize_idle_skip(cfg))
+		goto bail;
+	/* these enable columns: shm, rollup & summary lay out from the set */
+	if (!initialize_work(cfg))
 		goto bail;
+	if (!initialize_adaptive(cfg))
+		goto bail;
+
+	/* live snapshot is optional. carry on logging without it */
+	if (!initialize_shm_export(cfg))
+		printf("failed to export snapshot to /dev/shm/%s\n", cfg->shm_name);
+
+	if (!initialize_rollup(cfg)) {
+		printf("failed to initialize rollup\n");
+		goto bail;
+	}
+
+	if (!initialize_summary(cfg)) {
+		printf("failed to initialize summary\n");
+		goto bail;
+	}
+
+	if (!initialize_metrics(cfg)) {
+		printf("failed to start metrics exporter on %s\n", cfg->metrics_addr);
+	} else if (cfg->metrics_addr[0]) {
+		if (pthread_create(&metrics_thread, &attr_io,
+				(void *)&metrics_serve, (void *)cfg))
+			perror("metrics thread create");
+		else
+			metrics_started = 1;
+	}
+
+	if (!initialize_scenario(cfg)) {
+		printf("failed to load scenario %s\n", cfg->scenario_file);
+		goto bail;
+	}
+
+	if (!initialize_sweep(cfg)) {
+		printf("failed to set up sweep\n");
+		goto bail;
+	}
+
+	if (!initialize_burst(cfg)) {
+		printf("failed to set up burst capture\n");
+		goto bail;
+	}
+
+	if (!initialize_step(cfg)) {
+		printf("failed to set up step response\n");
+		goto bail;
+	}
+
+	if (!initialize_events(cfg))
+		goto bail;
+
+	if (!initialize_trace_freq(cfg)) {
+		printf("failed to set up power tracepoints\n");
+		goto bail;
+	}
+
+	if (!initialize_os_stats(cfg)) {
+		printf("failed to open cpufreq/cpuidle statistics\n");
+		goto bail;
+	}
+
+	if (!initialize_derive(cfg))
+		goto bail;
+
+	if (!initialize_control(cfg)) {
+		printf("failed to open control socket %s\n", cfg->control_path);
+		goto bail;
+	}
 
 	/* thread for deferred disk IO of logs */
 	if (pthread_create(&io_thread, &attr_io,
@@ -502,7 +799,28 @@ int main(int argc, char *argv[])
 	}
 
 	pthread_attr_setdetachstate(&attr_t, PTHREAD_CREATE_JOINABLE);
-	/* fork pthreads for each logical cpu selected & set affinity to cpu. */
+
+	/* workers and the sampler (if any) start together */
+	pthread_barrier_init(&start_barrier, NULL,
+				nr_threads + (cfg->sampler_cpu >= 0));
+
+	/* sampler reads cpu0's duty cycle the way the inline logger does */
+	if (cfg->sampler_cpu >= 0) {
+		ret = pthread_create(&sampler_thread, &attr_t,
+				(void *)&sampler_fn, (void *)&data_ptr[0]);
+		if (ret) {
+			perror("sampler thread create. sampling inline");
+			cfg->sampler_cpu = -1;
+			pthread_barrier_destroy(&start_barrier);
+			pthread_barrier_init(&start_barrier, NULL, nr_threads);
+		}
+	}
+
+	/* op counts are read from the first sample on */
+	work_attach(data_ptr, nr_threads);
+
+	srand(time(NULL) ^ getpid());
+	/* one worker per logical cpu selected, affine to that cpu */
 	for (c = 0, t = 0; c < CPU_SETSIZE && t < nr_threads; c++) {
 		if (!CPU_ISSET(c, &cfg->cpumask))
 			continue;
@@ -511,13 +829,54 @@ int main(int argc, char *argv[])
 		data_ptr[t].affinity_pr = c;
 		data_ptr[t].psn = pst->psn;
 		data_ptr[t].psa = pst->psa;
-		ret = pthread_create(&thread_ptr[t], &attr_t, (void *)&work_fn,
-							(void *)&data_ptr[t]);
+		data_ptr[t].ctl_gen = 0;
+		data_ptr[t].ctl_parked = 0;
+		data_ptr[t].ctl_psn = (c == 0 && dont_stress_cpu0) ?
+							NONE : pst->psn;
+		data_ptr[t].ctl_psa = pst->psa;
+		switch (cfg->phase) {
+		case PHASE_STAGGER:
+			data_ptr[t].phase_us = IA_TICK_USEC / nr_threads * t;
+			break;
+		case PHASE_RANDOM:
+			data_ptr[t].phase_us = rand() % IA_TICK_USEC;
+			break;
+		default:
+			data_ptr[t].phase_us = 0;
+			break;
+		}
+		dbg_print("cpu%d phase %dus\n", c, data_ptr[t].phase_us);
+		t++;
+	}
+
+	/*
+	 * the scenario engine drives workers through control's mailboxes,
+	 * from the first sample on: attach before any worker can take it.
+	 */
+	control_attach(data_ptr, t);
+
+	for (i = 0; i < t; i++) {
+		ret = pthread_create(&thread_ptr[i], &attr_t, (void *)&work_fn,
+							(void *)&data_ptr[i]);
 		if (ret) {
 			perror("Failed pthread create");
 			goto bail;
 		}
-		t++;
+	}
+	if (cfg->control_path[0]) {
+		if (pthread_create(&control_thread, &attr_io,
+				(void *)&control_serve, NULL))
+			perror("control thread create");
+		else
+			control_started = 1;
+	}
+
+	if (cfg->burst_us) {
+		if (pthread_create(&burst_thread, &attr_t,
+				(void *)&burst_fn, NULL))
+			perror("burst thread create");
+		else
+			burst_started = 1;
 	}
 
 	if (signal(SIGINT, psst_signal_handler) == SIG_ERR)
@@ -526,9 +885,20 @@ int main(int argc, char *argv[])
 	/* attr not needed after create */
 	pthread_attr_destroy(&attr_t);
 	dbg_print("Created %d Thread + 1 io thread\n", t);
+	/* sampler reads every cpu's msr. stop it before fds are closed */
+	if (cfg->sampler_cpu >= 0) {
+		pthread_join(sampler_thread, &res);
+		sampler_report();
+	}
+	/* burst capture reads msrs too */
+	if (burst_started) {
+		pthread_join(burst_thread, &res);
+		burst_report();
+	}
 	while (0 < t--) {
 		pthread_join(thread_ptr[t], &res);
-		close(perf_stats[t].dev_msr_fd);
+		if (perf_stats[t].dev_msr_supported)
+			close(perf_stats[t].dev_msr_fd);
 		dbg_print("Thread %d cleaned\n", t);
 	}
 
@@ -539,6 +909,25 @@ int main(int argc, char *argv[])
 	pthread_attr_destroy(&attr_io);
 	pthread_join(io_thread, &res);
 	dbg_print("IO Thread cleaned\n");
+	if (metrics_started)
+		pthread_join(metrics_thread, &res);
+	if (control_started)
+		pthread_join(control_thread, &res);
+	finish_metrics(cfg);
+	finish_rollup();
+	finish_summary(cfg);
+	finish_shm_export(cfg);
+	finish_control(cfg);
+	finish_sweep(cfg);
+	finish_step(cfg);
+	finish_adaptive();
+	finish_derive();
+	finish_work();
+	finish_trace_freq(cfg);
+	finish_os_stats();
+	finish_fallback();
+	finish_idle_skip();
+	selfstat_report();
 
 bail:
 	return 1;
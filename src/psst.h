@@ -29,6 +29,8 @@
 
 #define DEFAULT_TICK_USEC (IA_TICK_USEC)
 
+#define CACHE_LINE_SIZE (64)
+
 #define MIN_LOAD (0.10)
 #define MAX_LOAD (100)
 
@@ -80,32 +82,48 @@ typedef struct {
 	struct timespec begin;
 } ps_t;
 
+/*
+ * per worker. duty_cycle is rewritten on every ON loop iteration, so each
+ * worker's block gets its own cache line(s) to avoid false sharing.
+ */
 typedef struct {
 	float duty_cycle;
 	int affinity_pr;
+	int phase_us;		/* ON window offset in each tick (--phase) */
 	enum power_shape_name psn;
 	power_shape_attr_t psa;
-} data_t;
+	/* mailbox from the control socket (--control), see control.c */
+	unsigned int ctl_gen;
+	int ctl_parked;
+	enum power_shape_name ctl_psn;
+	power_shape_attr_t ctl_psa;
+	/* ON phase work done, see work.c */
+	uint64_t ops;
+	uint64_t work_state;
+} __attribute__((aligned(CACHE_LINE_SIZE))) data_t;
 
 typedef struct {
 	int last_time_taken;
 	struct timespec ts;
 } perf_t;
 
+/* per-cpu msr access. the sampled values live in perf_diffs (perf_msr.h) */
 typedef struct {
         int cpu;
         int dev_msr_fd;
         int dev_msr_supported;
-        uint64_t aperf_diff;
-        uint64_t mperf_diff;
-        uint64_t pperf_diff;
-        uint64_t tsc_diff;
-        uint64_t nperf;
 } perf_stats_t;
 
 extern int is_time_remaining(clockid_t, struct timespec *, int, int);
+extern int ts_compare(struct timespec *, struct timespec *);
+extern void timespec_add_ns(struct timespec *ts, uint64_t ns);
+extern void wait_start_epoch(struct timespec *epoch);
+extern int set_affinity(int pr);
+extern int set_sched_priority(int min_max);
+extern int power_shaping(ps_t *ps, float *v_unit);
 extern unsigned int *perf_time;
 extern uint64_t pp0_diff_uj, soc_diff_uj[4];
+extern uint64_t pp0_total_uj, soc_total_uj[4];
 extern int exit_cpu_thread, exit_io_thread;
 
 #endif
@@ -0,0 +1,85 @@
+/*
+ * psst_shm.h: layout of the live telemetry snapshot psst exports with
+ * --shm <name> (/dev/shm/<name>). Self contained, meant to be copied
+ * into consumers.
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _PSST_SHM_H_
+#define _PSST_SHM_H_
+#include <stdint.h>
+
+#define PSST_SHM_MAGIC		0x54535350	/* "PSST" little endian */
+#define PSST_SHM_VERSION	1
+
+/*
+ * Segment layout:
+ *	struct psst_shm_hdr
+ *	struct psst_shm_col [nr_cols]	at col_offset
+ *	struct psst_shm_cpu [nr_cpus]	at cpu_offset
+ *
+ * The layout (offsets, counts, names) is fixed before magic is set and
+ * never changes afterwards. Values are protected by a seqlock: seq is
+ * odd while psst updates a sample. A reader does
+ *
+ *	for (;;) {
+ *		s = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+ *		if (s & 1)
+ *			continue;	(psst is mid update: retry)
+ *		<copy the values it needs>
+ *		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *		if (s == __atomic_load_n(&hdr->seq, __ATOMIC_RELAXED))
+ *			break;		(copy is consistent)
+ *	}
+ *
+ * Readers must accept any segment with the same version and only rely on
+ * hdr_size/col_size/cpu_size strides, so fields can be appended without a
+ * version change. version changes only when existing fields change.
+ */
+struct psst_shm_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_size;
+	uint32_t col_size;
+	uint32_t cpu_size;
+	uint32_t nr_cols;
+	uint32_t nr_cpus;
+	uint32_t col_offset;
+	uint32_t cpu_offset;
+	uint32_t total_size;
+	int32_t pid;
+	int32_t cpu_hfm_mhz;	/* to turn aperf/mperf ratios into MHz */
+	int32_t poll_period_ms;
+	uint64_t seq;
+	uint64_t sample_count;
+	double time_ms;		/* same as the Time column */
+};
+
+struct psst_shm_col {
+	char name[32];
+	char unit[32];
+	double value;
+};
+
+struct psst_shm_cpu {
+	int32_t cpu;
+	int32_t msr_supported;
+	uint64_t aperf_diff;
+	uint64_t mperf_diff;
+	uint64_t pperf_diff;
+	uint64_t tsc_diff;
+	uint64_t nperf;
+};
+#endif
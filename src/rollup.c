@@ -0,0 +1,249 @@
+/*
+ * rollup.c: streaming min/max/mean/stddev of each column over fixed windows
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "rollup.h"
+#include "logger.h"
+
+#define ROLLUP_BUF_SZ (4096 * 2)
+/* per column: 4 stats, each a ",%12s" cell or a header name_stat */
+#define ROLLUP_PER_COL_SZ (4 * 48)
+
+/* Welford running moments. n is per column: non-finite samples skipped */
+struct col_stat {
+	long n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+};
+
+struct rollup {
+	int window_ms;
+	long long window;	/* index of window being accumulated */
+	long samples;
+	int fd;
+	char *buf;
+	int filled;
+	struct col_stat st[MAX_COL_NUM];
+};
+
+static struct rollup *rollups;
+static int nr_rollups;
+static char *row;
+static int row_sz, buf_sz;
+/* rollup column slot -> col_desc[] index, fixed at init like the header */
+static int rollup_col_map[MAX_COL_NUM];
+static int nr_rollup_cols;
+
+static void reset_window(struct rollup *r, long long window)
+{
+	int i;
+
+	r->window = window;
+	r->samples = 0;
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		r->st[i].n = 0;
+		r->st[i].mean = 0;
+		r->st[i].m2 = 0;
+		r->st[i].min = DBL_MAX;
+		r->st[i].max = -DBL_MAX;
+	}
+}
+
+/*
+ * rows are buffered and written out a page at a time. a 1s window is a
+ * write syscall every few seconds; nothing worth a thread of its own.
+ */
+static void flush_buf(struct rollup *r)
+{
+	int wr_sz;
+
+	if (!r->filled)
+		return;
+	wr_sz = write(r->fd, r->buf, r->filled);
+	if (wr_sz == -1)
+		perror("rollup write");
+	r->filled = 0;
+}
+
+static void buf_append(struct rollup *r, char *row, int sz)
+{
+	if (buf_sz - r->filled < sz)
+		flush_buf(r);
+	memcpy(r->buf + r->filled, row, sz);
+	r->filled += sz;
+}
+
+static void write_header(struct rollup *r)
+{
+	int i, sz = 0;
+	static const char *stat_name[] = {"min", "max", "mean", "sd"};
+
+	sz += sprintf(row + sz, "#%9s,%7s", "Start", "N");
+	for (i = 0; i < nr_rollup_cols; i++) {
+		for (int s = 0; s < 4; s++) {
+			char name[48];
+			snprintf(name, sizeof(name), "%s_%s",
+				col_desc[rollup_col_map[i]].header_name,
+				stat_name[s]);
+			sz += sprintf(row + sz, ",%12s", name);
+		}
+	}
+	sz += sprintf(row + sz, "\n#%9s,%7s", "[ms]", "[#]");
+	for (i = 0; i < nr_rollup_cols; i++) {
+		for (int s = 0; s < 4; s++)
+			sz += sprintf(row + sz, ",%12s",
+					col_desc[rollup_col_map[i]].unit);
+	}
+	sz += sprintf(row + sz, "\n");
+	buf_append(r, row, sz);
+}
+
+static void emit_window(struct rollup *r)
+{
+	int i, sz = 0;
+	double sd;
+	struct col_stat *st;
+
+	if (!r->samples)
+		return;
+
+	sz += sprintf(row + sz, "%10lld,%7ld",
+			r->window * r->window_ms, r->samples);
+	for (i = 0; i < nr_rollup_cols; i++) {
+		st = &r->st[i];
+		if (!st->n) {
+			sz += sprintf(row + sz, ",%12s,%12s,%12s,%12s",
+						"nan", "nan", "nan", "nan");
+			continue;
+		}
+		sd = (st->n > 1) ? sqrt(st->m2 / (st->n - 1)) : 0;
+		sz += sprintf(row + sz, ",%12.2f,%12.2f,%12.2f,%12.2f",
+					st->min, st->max, st->mean, sd);
+	}
+	sz += sprintf(row + sz, "\n");
+	buf_append(r, row, sz);
+}
+
+int initialize_rollup(struct config *cfg)
+{
+	int i, n = 0;
+	char name[MAX_LEN];
+
+	if (!cfg->nr_rollups)
+		return 1;
+
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (col_desc[i].report_enabled && i != TIME_STAMP_MS)
+			rollup_col_map[n++] = i;
+	}
+	nr_rollup_cols = n;
+	/* header is two rows (names & units) */
+	row_sz = 2 * (64 + n * ROLLUP_PER_COL_SZ);
+	buf_sz = (row_sz > ROLLUP_BUF_SZ) ? row_sz : ROLLUP_BUF_SZ;
+	row = malloc(row_sz);
+	rollups = calloc(cfg->nr_rollups, sizeof(struct rollup));
+	if (!rollups || !row) {
+		perror("alloc rollups");
+		return 0;
+	}
+	for (i = 0; i < cfg->nr_rollups; i++) {
+		struct rollup *r = &rollups[i];
+
+		r->window_ms = cfg->rollup_ms[i];
+		r->buf = malloc(buf_sz);
+		if (!r->buf) {
+			perror("malloc rollup buf");
+			return 0;
+		}
+		snprintf(name, sizeof(name), ROLLUP_NAME_FMT,
+					cfg->log_file_name, r->window_ms);
+		r->fd = open(name, O_RDWR|O_CREAT|O_TRUNC,
+				S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+		if (r->fd == -1) {
+			perror("rollup file");
+			return 0;
+		}
+		reset_window(r, 0);
+		write_header(r);
+		nr_rollups++;
+	}
+	return 1;
+}
+
+/* called from the logging context once column values are final */
+void rollup_sample(void)
+{
+	int i, k;
+	long long window;
+	double v, delta;
+	struct col_stat *st;
+
+	for (k = 0; k < nr_rollups; k++) {
+		struct rollup *r = &rollups[k];
+
+		/* windows are aligned to multiples of W on the Time column */
+		window = (long long)col_desc[TIME_STAMP_MS].value / r->window_ms;
+		if (window != r->window) {
+			emit_window(r);
+			reset_window(r, window);
+		}
+
+		r->samples++;
+		for (i = 0; i < nr_rollup_cols; i++) {
+			v = col_desc[rollup_col_map[i]].value;
+			if (!isfinite(v))
+				continue;
+			st = &r->st[i];
+			st->n++;
+			delta = v - st->mean;
+			st->mean += delta / st->n;
+			st->m2 += delta * (v - st->mean);
+			if (v < st->min)
+				st->min = v;
+			if (v > st->max)
+				st->max = v;
+		}
+	}
+}
+
+/* emits the partial last window too */
+void finish_rollup(void)
+{
+	int k;
+
+	for (k = 0; k < nr_rollups; k++) {
+		emit_window(&rollups[k]);
+		flush_buf(&rollups[k]);
+		close(rollups[k].fd);
+		free(rollups[k].buf);
+	}
+	free(rollups);
+	free(row);
+	rollups = NULL;
+	nr_rollups = 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _ROLLUP_H_
+#define _ROLLUP_H_
+#include "parse_config.h"
+
+/* rollup over window W ms of log file "name" goes to "name.rollup-Wms" */
+#define ROLLUP_NAME_FMT "%s.rollup-%dms"
+
+extern int initialize_rollup(struct config *cfg);
+extern void rollup_sample(void);
+extern void finish_rollup(void);
+#endif
@@ -0,0 +1,116 @@
+/*
+ * sampler.c: timer driven sampling thread (--sampler-cpu)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include "sampler.h"
+#include "parse_config.h"
+#include "logger.h"
+#include "selfstat.h"
+
+/*
+ * By default samples are taken from inside cpu0's ON loop, which polls
+ * the clock on every iteration and runs late whenever cpu0 is in its OFF
+ * phase. The sampler thread instead sleeps until the exact next poll
+ * boundary (first_tm + k * poll period) with an absolute timer.
+ *
+ * Its own cpu time is published in sampler_cpu_ns. The worker pinned to
+ * the same cpu subtracts it from its ON budget, so the core's total load
+ * still matches the requested duty cycle.
+ */
+uint64_t sampler_cpu_ns;
+uint64_t sampler_samples, sampler_late;
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		perror("clock_gettime");
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void sampler_fn(void *data)
+{
+	int ret;
+	uint64_t poll_ns, cpu_then, cpu_now;
+	data_t *cpu0_data = (data_t *)data;
+	struct timespec next, now;
+	sigset_t maskset;
+
+	sigfillset(&maskset);
+	ret = pthread_sigmask(SIG_BLOCK, &maskset, NULL);
+	if (ret)
+		printf("Couldn't mask signals in sampler_fn. err:%d\n", ret);
+
+	set_affinity(configpv.sampler_cpu);
+	set_sched_priority(1);
+
+	wait_start_epoch(&next);
+	cpu_then = thread_cpu_ns();
+	initialize_sampling(&next);
+
+	while (!exit_cpu_thread) {
+		do {
+			ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+								&next, NULL);
+		} while (ret == EINTR && !exit_cpu_thread);
+
+		if (clock_gettime(CLOCK_MONOTONIC, &now))
+			perror("clock_gettime");
+
+		/* duration_* is the total time this tool runs */
+		if (!is_time_remaining(CLOCK_MONOTONIC, &first_tm,
+					duration_sec, duration_nsec))
+			exit_cpu_thread = 1;
+
+		selfstat_jitter(&next, &now);
+		log_sample(cpu0_data->duty_cycle, &now);
+		sampler_samples++;
+
+		cpu_now = thread_cpu_ns();
+		__atomic_add_fetch(&sampler_cpu_ns, cpu_now - cpu_then,
+							__ATOMIC_RELAXED);
+		cpu_then = cpu_now;
+
+		/* poll period may be changed on the fly. read it every time */
+		poll_ns = (uint64_t)plog_poll_sec * NSEC_PER_SEC + plog_poll_nsec;
+		timespec_add_ns(&next, poll_ns);
+
+		/* overran one or more boundaries: skip them, don't burst */
+		if (clock_gettime(CLOCK_MONOTONIC, &now))
+			perror("clock_gettime");
+		while (ts_compare(&next, &now) <= 0) {
+			timespec_add_ns(&next, poll_ns);
+			sampler_late++;
+		}
+	}
+	pthread_exit(NULL);
+}
+
+void sampler_report(void)
+{
+	printf("Sampler on cpu%d: %llu samples, %llu late, cpu time %.3f ms\n",
+			configpv.sampler_cpu,
+			(unsigned long long)sampler_samples,
+			(unsigned long long)sampler_late,
+			(double)sampler_cpu_ns / 1000000);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+#include <stdint.h>
+
+extern uint64_t sampler_cpu_ns;
+extern uint64_t sampler_samples, sampler_late;
+
+extern void sampler_fn(void *data);
+extern void sampler_report(void);
+#endif
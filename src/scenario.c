@@ -0,0 +1,401 @@
+/*
+ * scenario.c: multi-phase test plans from a file (--scenario)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scenario.h"
+#include "control.h"
+#include "logger.h"
+
+#define MAX_PHASES (64)
+#define MAX_PHASE_SHAPES (16)
+#define SCENARIO_LINE_LEN (256)
+/* trailing samples kept for "until stable" */
+#define STABLE_RING (4096)
+
+/*
+ * A scenario file is a list of phases run back to back, one keyword per
+ * line, '#' starts a comment:
+ *
+ *	repeat 2			whole plan, before the first phase
+ *	phase warmup			starts a phase, name is optional
+ *	duration 30000			ms. upper bound of the phase
+ *	shape single-step,40		every stressed cpu
+ *	shape linear-ramp,5 2-3		cpus 2 and 3 (cpuset list)
+ *	poll 100			ms, from this phase on
+ *	until energy 500		J of package energy in this phase
+ *	until temp 85			DegC, hottest of CpuDts and SocDts
+ *	until stable 2 5000		pwrPkg0 within 2% of its mean for 5s
+ *	repeat 3			this phase, back to back
+ *
+ * Stressed cpus without a shape line in a phase idle at MIN_LOAD for it.
+ * A phase ends at the first sample that meets any of its conditions.
+ */
+struct phase_shape {
+	int all;
+	cpu_set_t cpus;
+	data_t shape;
+};
+
+struct phase {
+	char name[32];
+	long long duration_ms;
+	int poll_ms;
+	int repeat;
+	int nr_shapes;
+	struct phase_shape shape[MAX_PHASE_SHAPES];
+	double energy_j;
+	double temp_c;
+	double stable_pct;
+	int stable_ms;
+};
+
+static struct phase *phases;
+static int nr_phases;
+static int plan_repeat = 1;
+static int scenario_enabled;
+
+/* run state, sampling context only */
+static int cur = -1;		/* index in phases[] */
+static int cur_rep, plan_rep;
+static double phase_start_ms;
+static double phase_start_uj;
+static struct {
+	double time_ms;
+	double mw;
+} ring[STABLE_RING];
+static int ring_head, ring_n;
+
+static int parse_phase_line(struct phase *p, char *key, char *arg1,
+			    char *arg2, char *arg3, struct config *cfg)
+{
+	struct phase_shape *s;
+	char cpus[SCENARIO_LINE_LEN];
+	int c;
+
+	if (!strcmp(key, "duration") && arg1) {
+		p->duration_ms = atoll(arg1);
+		return p->duration_ms > 0;
+	}
+	if (!strcmp(key, "poll") && arg1) {
+		p->poll_ms = atoi(arg1);
+		return p->poll_ms > 0;
+	}
+	if (!strcmp(key, "repeat") && arg1) {
+		p->repeat = atoi(arg1);
+		return p->repeat > 0;
+	}
+	if (!strcmp(key, "shape") && arg1) {
+		if (p->nr_shapes == MAX_PHASE_SHAPES) {
+			printf("more than %d shapes in a phase\n",
+							MAX_PHASE_SHAPES);
+			return 0;
+		}
+		s = &p->shape[p->nr_shapes];
+		if (!parse_power_shape(arg1, &s->shape))
+			return 0;
+		s->all = !arg2;
+		if (arg2) {
+			/* cpuset_to_bitmap wants the procfs line format */
+			snprintf(cpus, sizeof(cpus), "%s\n", arg2);
+			CPU_ZERO(&s->cpus);
+			cpuset_to_bitmap(cpus, &s->cpus);
+			for (c = 0; c < CPU_SETSIZE; c++) {
+				if (CPU_ISSET(c, &s->cpus) &&
+				    !CPU_ISSET(c, &cfg->cpumask)) {
+					printf("cpu%d is not in --cpumask\n", c);
+					return 0;
+				}
+			}
+		}
+		p->nr_shapes++;
+		return 1;
+	}
+	if (!strcmp(key, "until") && arg1 && arg2) {
+		if (!strcmp(arg1, "energy")) {
+			p->energy_j = atof(arg2);
+			return p->energy_j > 0;
+		}
+		if (!strcmp(arg1, "temp")) {
+			p->temp_c = atof(arg2);
+			return p->temp_c > 0;
+		}
+		if (!strcmp(arg1, "stable") && arg3) {
+			p->stable_pct = atof(arg2);
+			p->stable_ms = atoi(arg3);
+			return p->stable_pct > 0 && p->stable_ms > 0;
+		}
+	}
+	return 0;
+}
+
+/* a phase needs an end, and "until stable" must fit the sample ring */
+static int check_phase(struct phase *p, int poll_ms)
+{
+	if (!p->duration_ms && p->energy_j <= 0 && p->temp_c <= 0 &&
+							!p->stable_ms) {
+		printf("phase %s has neither duration nor until\n", p->name);
+		return 0;
+	}
+	if (p->stable_ms / poll_ms >= STABLE_RING) {
+		printf("phase %s: until stable window is over %d samples\n",
+						p->name, STABLE_RING);
+		return 0;
+	}
+	if ((p->energy_j > 0 || p->stable_ms) &&
+				!col_desc[PKG0_POWER_RAPL].report_enabled)
+		printf("phase %s: no package RAPL. energy/stable ignored\n",
+								p->name);
+	if (p->temp_c > 0 && !col_desc[CPU_DTS].report_enabled &&
+				!col_desc[SOC_DTS].report_enabled)
+		printf("phase %s: no DTS. temp ignored\n", p->name);
+	return 1;
+}
+
+int initialize_scenario(struct config *cfg)
+{
+	FILE *fp;
+	struct phase *p = NULL;
+	char line[SCENARIO_LINE_LEN], *hash, *key, *a1, *a2, *a3, *save;
+	int lineno = 0, poll_ms, i;
+
+	if (!cfg->scenario_file[0])
+		return 1;
+
+	fp = fopen(cfg->scenario_file, "r");
+	if (!fp) {
+		perror("scenario file");
+		return 0;
+	}
+	phases = calloc(MAX_PHASES, sizeof(struct phase));
+	if (!phases) {
+		perror("calloc phases");
+		fclose(fp);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		hash = strchr(line, '#');
+		if (hash)
+			*hash = '\0';
+		key = strtok_r(line, " \t\r\n", &save);
+		if (!key)
+			continue;
+		a1 = strtok_r(NULL, " \t\r\n", &save);
+		a2 = strtok_r(NULL, " \t\r\n", &save);
+		a3 = strtok_r(NULL, " \t\r\n", &save);
+
+		if (!strcmp(key, "phase")) {
+			if (nr_phases == MAX_PHASES) {
+				printf("%s:%d: more than %d phases\n",
+					cfg->scenario_file, lineno, MAX_PHASES);
+				goto err;
+			}
+			p = &phases[nr_phases++];
+			p->repeat = 1;
+			snprintf(p->name, sizeof(p->name), "%s",
+						a1 ? a1 : "-");
+			continue;
+		}
+		if (!p && !strcmp(key, "repeat") && a1 && atoi(a1) > 0) {
+			plan_repeat = atoi(a1);
+			continue;
+		}
+		if (!p || !parse_phase_line(p, key, a1, a2, a3, cfg)) {
+			printf("%s:%d: bad line \"%s\"\n", cfg->scenario_file,
+							lineno, key);
+			goto err;
+		}
+	}
+	fclose(fp);
+
+	if (!nr_phases) {
+		printf("%s: no phase\n", cfg->scenario_file);
+		return 0;
+	}
+	/* poll carries over from phase to phase */
+	for (i = 0, poll_ms = cfg->poll_period; i < nr_phases; i++) {
+		if (phases[i].poll_ms)
+			poll_ms = phases[i].poll_ms;
+		if (!check_phase(&phases[i], poll_ms))
+			return 0;
+	}
+	scenario_enabled = 1;
+	return 1;
+err:
+	fclose(fp);
+	return 0;
+}
+
+/* Phase column: 1 based index in the file, 0 before the plan starts */
+int scenario_phase_id(void)
+{
+	return cur + 1;
+}
+
+static double package_uj(void)
+{
+	int i;
+	double uj = 0;
+
+	for (i = PKG0_POWER_RAPL; i <= PKG3_POWER_RAPL; i++) {
+		if (col_desc[i].report_enabled)
+			uj += soc_total_uj[i - PKG0_POWER_RAPL];
+	}
+	return uj;
+}
+
+static void start_phase(void)
+{
+	struct phase *p = &phases[cur];
+	data_t idle, *shape;
+	char text[MAX_MARK_LEN];
+	int c, s;
+
+	memset(&idle, 0, sizeof(idle));
+	idle.psn = SINGLE_STEP;
+	idle.psa.single_step.v_units = MIN_LOAD;
+
+	/* last matching shape line wins */
+	for (c = 0; c < CPU_SETSIZE; c++) {
+		if (!CPU_ISSET(c, &configpv.cpumask))
+			continue;
+		shape = &idle;
+		for (s = 0; s < p->nr_shapes; s++) {
+			if (p->shape[s].all ? !(c == 0 && dont_stress_cpu0) :
+					CPU_ISSET(c, &p->shape[s].cpus))
+				shape = &p->shape[s].shape;
+		}
+		control_set_shape(c, shape);
+	}
+	if (p->poll_ms)
+		set_poll_period(p->poll_ms);
+
+	phase_start_ms = col_desc[TIME_STAMP_MS].value;
+	phase_start_uj = package_uj();
+	ring_head = ring_n = 0;
+
+	snprintf(text, sizeof(text),
+			"phase %d %s start: repeat %d/%d plan %d/%d", cur + 1, p->name, cur_rep + 1, p->repeat,
+			plan_rep + 1, plan_repeat);
+	control_mark(text);
+}
+
+/* pwrPkg0 within stable_pct of its mean over the trailing stable_ms */
+static int power_stable(struct phase *p, double now_ms)
+{
+	int i, k;
+	double mw, min = 0, max = 0, sum = 0;
+	int n = 0;
+
+	ring[ring_head].time_ms = now_ms;
+	ring[ring_head].mw = col_desc[PKG0_POWER_RAPL].value;
+	ring_head = (ring_head + 1) % STABLE_RING;
+	if (ring_n < STABLE_RING)
+		ring_n++;
+
+	if (now_ms - phase_start_ms < p->stable_ms)
+		return 0;
+
+	for (i = 0; i < ring_n; i++) {
+		k = (ring_head - 1 - i + STABLE_RING) % STABLE_RING;
+		if (now_ms - ring[k].time_ms > p->stable_ms)
+			break;
+		mw = ring[k].mw;
+		if (!n || mw < min)
+			min = mw;
+		if (!n || mw > max)
+			max = mw;
+		sum += mw;
+		n++;
+	}
+	return n > 1 && (max - min) <= p->stable_pct / 100 * (sum / n);
+}
+
+/* why the current phase is over, or NULL */
+static const char *phase_done(struct phase *p)
+{
+	double now_ms = col_desc[TIME_STAMP_MS].value;
+	double temp = 0;
+	int rapl = col_desc[PKG0_POWER_RAPL].report_enabled;
+
+	if (p->duration_ms && now_ms - phase_start_ms >= p->duration_ms)
+		return "duration";
+	if (p->energy_j > 0 && rapl &&
+			(package_uj() - phase_start_uj) / 1000000 >= p->energy_j)
+		return "energy";
+	if (p->temp_c > 0) {
+		if (col_desc[CPU_DTS].report_enabled)
+			temp = col_desc[CPU_DTS].value;
+		if (col_desc[SOC_DTS].report_enabled &&
+				col_desc[SOC_DTS].value > temp)
+			temp = col_desc[SOC_DTS].value;
+		if (temp >= p->temp_c)
+			return "temp";
+	}
+	if (p->stable_ms && rapl && power_stable(p, now_ms))
+		return "stable";
+	return NULL;
+}
+
+/*
+ * sampling context, after the record is final: a record carries the
+ * phase that ran during its interval, the next one the new phase.
+ */
+void scenario_sample(void)
+{
+	struct phase *p;
+	const char *why;
+	char text[MAX_MARK_LEN];
+
+	if (!scenario_enabled || exit_cpu_thread)
+		return;
+
+	if (cur < 0) {
+		cur = 0;
+		start_phase();
+		return;
+	}
+
+	p = &phases[cur];
+	why = phase_done(p);
+	if (!why)
+		return;
+
+	snprintf(text, sizeof(text), "phase %d %s end: %s after %.0f ms",
+			cur + 1, p->name, why,
+			col_desc[TIME_STAMP_MS].value - phase_start_ms);
+	control_mark(text);
+
+	if (++cur_rep == p->repeat) {
+		cur_rep = 0;
+		if (++cur == nr_phases) {
+			cur = 0;
+			if (++plan_rep == plan_repeat) {
+				cur = nr_phases - 1;
+				printf("scenario %s done\n",
+						configpv.scenario_file);
+				exit_cpu_thread = 1;
+				return;
+			}
+		}
+	}
+	start_phase();
+}
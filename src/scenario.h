@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _SCENARIO_H_
+#define _SCENARIO_H_
+#include "parse_config.h"
+
+/* without -d, a scenario runs until its last phase ends */
+#define SCENARIO_DURATION_MS (365LL * 24 * 3600 * 1000)
+
+extern int initialize_scenario(struct config *cfg);
+extern int scenario_phase_id(void);
+extern void scenario_sample(void);
+#endif
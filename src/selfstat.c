@@ -0,0 +1,215 @@
+/*
+ * selfstat.c: psst's own sampling jitter and overhead (--self-stats)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include "selfstat.h"
+#include "logger.h"
+#include "parse_config.h"
+
+/*
+ * Log-linear histogram of nanoseconds: values below 2^SUB_BITS get a bin
+ * each, above that every power of two is split into 2^SUB_BITS linear
+ * bins, so a bin is never wider than ~3% of its value. Covers up to
+ * 2^MAX_BITS ns (~36 min); larger values land in the last bin.
+ */
+#define SUB_BITS	(5)
+#define SUB_BINS	(1 << SUB_BITS)
+#define MAX_BITS	(41)
+#define HIST_BINS	((MAX_BITS - SUB_BITS + 1) * SUB_BINS)
+
+struct self_hist {
+	uint64_t bin[HIST_BINS];
+	uint64_t n, sum, min, max;
+	uint64_t last;		/* latest value, shown in the log column */
+};
+
+/*
+ * SELF_IO is written by the io thread, the others by the sampling
+ * context. Each histogram has a single writer; only .last is read
+ * across threads while running.
+ */
+static struct self_hist hist[NR_SELF_STATS];
+
+static const char *stat_name[NR_SELF_STATS] = {
+	"jitter", "log_sample", "update_perf_diffs",
+	"accumulate_flush_record", "io_write",
+};
+
+static int hist_index(uint64_t v)
+{
+	int shift;
+
+	if (v < SUB_BINS)
+		return v;
+	if (v >> MAX_BITS)
+		return HIST_BINS - 1;
+	shift = 63 - __builtin_clzll(v) - SUB_BITS;
+	return (shift + 1) * SUB_BINS + (int)(v >> shift) - SUB_BINS;
+}
+
+static uint64_t bin_low(int b)
+{
+	int shift;
+
+	if (b < SUB_BINS)
+		return b;
+	shift = b / SUB_BINS - 1;
+	return (uint64_t)(SUB_BINS + b % SUB_BINS) << shift;
+}
+
+static uint64_t bin_high(int b)
+{
+	return b < SUB_BINS ? b + 1 : bin_low(b) + (1ULL << (b / SUB_BINS - 1));
+}
+
+static void hist_add(struct self_hist *h, uint64_t v)
+{
+	h->bin[hist_index(v)]++;
+	if (!h->n || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->n++;
+	h->sum += v;
+	__atomic_store_n(&h->last, v, __ATOMIC_RELAXED);
+}
+
+/* upper edge of the bin holding quantile q: never under-reports latency */
+static uint64_t hist_quantile(struct self_hist *h, double q)
+{
+	int b;
+	uint64_t cum = 0;
+
+	if (!h->n)
+		return 0;
+	for (b = 0; b < HIST_BINS; b++) {
+		cum += h->bin[b];
+		if (cum > q * (h->n - 1))
+			break;
+	}
+	if (b == HIST_BINS)
+		b--;
+	return bin_high(b) > h->max ? h->max : bin_high(b);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* free when --self-stats is off: no clock read */
+uint64_t selfstat_start(void)
+{
+	if (!configpv.self_stats)
+		return 0;
+	return now_ns();
+}
+
+void selfstat_end(enum self_stat s, uint64_t t0)
+{
+	if (!configpv.self_stats)
+		return;
+	hist_add(&hist[s], now_ns() - t0);
+}
+
+/* a sample is never early. anything before schedule is clock noise */
+void selfstat_jitter(struct timespec *sched, struct timespec *actual)
+{
+	if (!configpv.self_stats)
+		return;
+	if (ts_compare(actual, sched) <= 0)
+		hist_add(&hist[SELF_JITTER], 0);
+	else
+		hist_add(&hist[SELF_JITTER], diff_ns(sched, actual));
+}
+
+double selfstat_last_us(enum self_stat s)
+{
+	return (double)__atomic_load_n(&hist[s].last, __ATOMIC_RELAXED) / 1000;
+}
+
+void selfstat_report(void)
+{
+	int s;
+	struct timespec now;
+	uint64_t run_ns;
+	struct self_hist *h;
+
+	if (!configpv.self_stats)
+		return;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		perror("clock_gettime");
+	run_ns = diff_ns(&first_tm, &now);
+
+	printf("Self stats [us]:%18s %9s %9s %9s %9s %9s %9s\n", "n", "min",
+			"mean", "p50", "p99", "p99.9", "max");
+	for (s = 0; s < NR_SELF_STATS; s++) {
+		h = &hist[s];
+		printf("\t%-24s %9llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+			stat_name[s], (unsigned long long)h->n,
+			(double)h->min / 1000,
+			h->n ? (double)h->sum / h->n / 1000 : 0,
+			(double)hist_quantile(h, 0.5) / 1000,
+			(double)hist_quantile(h, 0.99) / 1000,
+			(double)hist_quantile(h, 0.999) / 1000,
+			(double)h->max / 1000);
+	}
+	if (run_ns)
+		printf("\tsampling context busy %.3f%% of the run, %.1f%% of one poll period at p99\n",
+			(double)hist[SELF_LOG].sum * 100 / run_ns,
+			(double)hist_quantile(&hist[SELF_LOG], 0.99) * 100 /
+				((double)configpv.poll_period * 1000000));
+}
+
+/* "self_ns" member of the --summary report */
+void selfstat_json(FILE *fp)
+{
+	int s, b, first;
+	struct self_hist *h;
+
+	fprintf(fp, "\t\"self_ns\": {");
+	for (s = 0; configpv.self_stats && s < NR_SELF_STATS; s++) {
+		h = &hist[s];
+		fprintf(fp, "%s\n\t\t\"%s\": {\"n\": %llu, \"min\": %llu, ",
+			s ? "," : "", stat_name[s],
+			(unsigned long long)h->n, (unsigned long long)h->min);
+		fprintf(fp, "\"max\": %llu, \"sum\": %llu, ",
+			(unsigned long long)h->max, (unsigned long long)h->sum);
+		fprintf(fp, "\"p50\": %llu, \"p99\": %llu, \"p99.9\": %llu, ",
+			(unsigned long long)hist_quantile(h, 0.5),
+			(unsigned long long)hist_quantile(h, 0.99),
+			(unsigned long long)hist_quantile(h, 0.999));
+		/* sparse: [bin low edge, count] of non-empty bins */
+		fprintf(fp, "\"hist\": [");
+		for (b = 0, first = 1; b < HIST_BINS; b++) {
+			if (!h->bin[b])
+				continue;
+			fprintf(fp, "%s[%llu,%llu]", first ? "" : ",",
+				(unsigned long long)bin_low(b),
+				(unsigned long long)h->bin[b]);
+			first = 0;
+		}
+		fprintf(fp, "]}");
+	}
+	fprintf(fp, "%s},\n", configpv.self_stats ? "\n\t" : "");
+}
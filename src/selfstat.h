@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _SELFSTAT_H_
+#define _SELFSTAT_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* what psst measures about itself (--self-stats) */
+enum self_stat { SELF_JITTER,	/* actual - scheduled sample time */
+		 SELF_LOG,	/* whole log_sample() */
+		 SELF_PERF,	/* update_perf_diffs() */
+		 SELF_FLUSH,	/* accumulate_flush_record() */
+		 SELF_IO,	/* io thread write() of a page */
+		 NR_SELF_STATS,};
+
+extern uint64_t selfstat_start(void);
+extern void selfstat_end(enum self_stat s, uint64_t t0);
+extern void selfstat_jitter(struct timespec *sched, struct timespec *actual);
+extern double selfstat_last_us(enum self_stat s);
+extern void selfstat_report(void);
+extern void selfstat_json(FILE *fp);
+#endif
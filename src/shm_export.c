@@ -0,0 +1,146 @@
+/*
+ * shm_export.c: publish the latest sample into a /dev/shm segment
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm_export.h"
+#include "psst_shm.h"
+#include "logger.h"
+#include "perf_msr.h"
+
+static struct psst_shm_hdr *shm_hdr;
+static struct psst_shm_col *shm_col;
+static struct psst_shm_cpu *shm_cpu;
+/* shm column slot -> col_desc[] index */
+static int shm_col_map[MAX_COL_NUM];
+
+int initialize_shm_export(struct config *cfg)
+{
+	int fd, i, n;
+	size_t sz, col_off, cpu_off;
+
+	if (!cfg->shm_name[0])
+		return 1;
+
+	for (i = 0, n = 0; i < MAX_COL_NUM; i++) {
+		if (col_desc[i].report_enabled)
+			shm_col_map[n++] = i;
+	}
+	col_off = sizeof(struct psst_shm_hdr);
+	cpu_off = col_off + n * sizeof(struct psst_shm_col);
+	sz = cpu_off + nr_threads * sizeof(struct psst_shm_cpu);
+
+	fd = shm_open(cfg->shm_name, O_RDWR|O_CREAT|O_TRUNC,
+				S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd == -1) {
+		perror("shm_open");
+		return 0;
+	}
+	if (ftruncate(fd, sz)) {
+		perror("shm ftruncate");
+		close(fd);
+		return 0;
+	}
+	shm_hdr = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm_hdr == MAP_FAILED) {
+		perror("shm mmap");
+		shm_hdr = NULL;
+		return 0;
+	}
+
+	shm_col = (struct psst_shm_col *)((char *)shm_hdr + col_off);
+	shm_cpu = (struct psst_shm_cpu *)((char *)shm_hdr + cpu_off);
+
+	/* static part of the schema, written once */
+	shm_hdr->version = PSST_SHM_VERSION;
+	shm_hdr->hdr_size = sizeof(struct psst_shm_hdr);
+	shm_hdr->col_size = sizeof(struct psst_shm_col);
+	shm_hdr->cpu_size = sizeof(struct psst_shm_cpu);
+	shm_hdr->nr_cols = n;
+	shm_hdr->nr_cpus = nr_threads;
+	shm_hdr->col_offset = col_off;
+	shm_hdr->cpu_offset = cpu_off;
+	shm_hdr->total_size = sz;
+	shm_hdr->pid = getpid();
+	shm_hdr->cpu_hfm_mhz = cpu_hfm_mhz;
+	shm_hdr->poll_period_ms = cfg->poll_period;
+	for (i = 0; i < n; i++) {
+		strncpy(shm_col[i].name, col_desc[shm_col_map[i]].header_name,
+						sizeof(shm_col[i].name) - 1);
+		strncpy(shm_col[i].unit, col_desc[shm_col_map[i]].unit,
+						sizeof(shm_col[i].unit) - 1);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		shm_cpu[i].cpu = perf_stats[i].cpu;
+		shm_cpu[i].msr_supported = perf_stats[i].dev_msr_supported;
+	}
+
+	/* readers key off magic: publish it last */
+	__atomic_store_n(&shm_hdr->magic, PSST_SHM_MAGIC, __ATOMIC_RELEASE);
+	dbg_print("shm snapshot /dev/shm/%s: %zu bytes\n", cfg->shm_name, sz);
+	return 1;
+}
+
+/* called from the logging context once column values are final */
+void shm_export_sample(void)
+{
+	int i;
+	uint64_t seq;
+
+	if (!shm_hdr)
+		return;
+
+	/* seqlock write side: odd seq, barrier, update, even seq */
+	seq = shm_hdr->seq;
+	__atomic_store_n(&shm_hdr->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (i = 0; i < (int)shm_hdr->nr_cols; i++)
+		shm_col[i].value = col_desc[shm_col_map[i]].value;
+	for (i = 0; i < nr_threads; i++) {
+		shm_cpu[i].aperf_diff = perf_diffs.aperf[i];
+		shm_cpu[i].mperf_diff = perf_diffs.mperf[i];
+		shm_cpu[i].pperf_diff = perf_diffs.pperf[i];
+		shm_cpu[i].tsc_diff = perf_diffs.tsc[i];
+		shm_cpu[i].nperf = perf_diffs.nperf[i];
+	}
+	shm_hdr->time_ms = col_desc[TIME_STAMP_MS].value;
+	shm_hdr->sample_count++;
+
+	__atomic_store_n(&shm_hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void finish_shm_export(struct config *cfg)
+{
+	size_t sz;
+
+	if (!shm_hdr)
+		return;
+
+	sz = shm_hdr->total_size;
+	munmap(shm_hdr, sz);
+	shm_hdr = NULL;
+	/* a stale snapshot must not look live to consumers */
+	if (shm_unlink(cfg->shm_name))
+		perror("shm_unlink");
+}
@@ -0,0 +1,151 @@
+/*
+ * sketch.c: bounded memory streaming quantiles (DDSketch)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "sketch.h"
+
+/* smaller magnitudes count as zero */
+#define SKETCH_MIN_VALUE (1e-9)
+
+static double log_gamma;
+
+void sketch_init(struct sketch *s)
+{
+	double gamma = (1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA);
+
+	log_gamma = log(gamma);
+	memset(s, 0, sizeof(*s));
+	s->min = DBL_MAX;
+	s->max = -DBL_MAX;
+}
+
+/* move the bucket window to start at new_offset. lower buckets collapse */
+static void store_shift(struct sketch_store *st, int new_offset)
+{
+	int i, j;
+	uint32_t tmp[SKETCH_BINS];
+
+	memset(tmp, 0, sizeof(tmp));
+	for (i = st->lo; i <= st->hi; i++) {
+		j = (i < new_offset) ? new_offset : i;
+		tmp[j - new_offset] += st->count[i - st->offset];
+	}
+	memcpy(st->count, tmp, sizeof(tmp));
+	st->offset = new_offset;
+	if (st->lo < new_offset)
+		st->lo = new_offset;
+	if (st->hi < new_offset)
+		st->hi = new_offset;
+}
+
+static void store_add(struct sketch_store *st, int idx)
+{
+	int new_offset;
+
+	if (!st->n) {
+		st->offset = idx - SKETCH_BINS / 2;
+		st->lo = st->hi = idx;
+	} else if (idx < st->offset) {
+		/* grow downwards as far as the top bucket allows */
+		new_offset = st->hi - SKETCH_BINS + 1;
+		if (new_offset < idx)
+			new_offset = idx;
+		if (new_offset < st->offset)
+			store_shift(st, new_offset);
+		if (idx < st->offset)
+			idx = st->offset;
+	} else if (idx >= st->offset + SKETCH_BINS) {
+		store_shift(st, idx - SKETCH_BINS + 1);
+	}
+	if (idx < st->lo)
+		st->lo = idx;
+	if (idx > st->hi)
+		st->hi = idx;
+	st->count[idx - st->offset]++;
+	st->n++;
+}
+
+static double bucket_value(int idx)
+{
+	double gamma = exp(log_gamma);
+
+	return 2 * exp(idx * log_gamma) / (gamma + 1);
+}
+
+void sketch_add(struct sketch *s, double v)
+{
+	if (!isfinite(v))
+		return;
+
+	if (v > SKETCH_MIN_VALUE)
+		store_add(&s->pos, (int)ceil(log(v) / log_gamma));
+	else if (v < -SKETCH_MIN_VALUE)
+		store_add(&s->neg, (int)ceil(log(-v) / log_gamma));
+	else
+		s->zero++;
+
+	s->n++;
+	s->sum += v;
+	if (v < s->min)
+		s->min = v;
+	if (v > s->max)
+		s->max = v;
+}
+
+double sketch_quantile(struct sketch *s, double q)
+{
+	int i;
+	double rank, v = 0;
+	uint64_t cum = 0;
+
+	if (!s->n)
+		return NAN;
+
+	rank = q * (s->n - 1);
+	/* ascending values: large negative magnitudes first */
+	for (i = s->neg.hi; s->neg.n && i >= s->neg.lo; i--) {
+		cum += s->neg.count[i - s->neg.offset];
+		if (cum > rank) {
+			v = -bucket_value(i);
+			goto found;
+		}
+	}
+	cum += s->zero;
+	if (cum > rank)
+		goto found;
+	for (i = s->pos.lo; s->pos.n && i <= s->pos.hi; i++) {
+		cum += s->pos.count[i - s->pos.offset];
+		if (cum > rank) {
+			v = bucket_value(i);
+			goto found;
+		}
+	}
+	v = s->max;
+found:
+	if (v < s->min)
+		v = s->min;
+	if (v > s->max)
+		v = s->max;
+	return v;
+}
+
+double sketch_mean(struct sketch *s)
+{
+	return s->n ? s->sum / s->n : NAN;
+}
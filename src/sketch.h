@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+#include <stdint.h>
+
+/*
+ * DDSketch: quantiles with relative error SKETCH_ALPHA in fixed memory.
+ * Buckets are geometric (gamma = (1+a)/(1-a)). 1024 of them cover ~9
+ * decades; beyond that the lowest buckets are collapsed, so tail (high)
+ * quantiles stay accurate.
+ */
+#define SKETCH_ALPHA	(0.01)
+#define SKETCH_BINS	(1024)
+
+struct sketch_store {
+	int offset;		/* bucket index of count[0] */
+	int lo, hi;		/* lowest & highest bucket index in use */
+	uint64_t n;
+	uint32_t count[SKETCH_BINS];
+};
+
+struct sketch {
+	struct sketch_store pos;
+	struct sketch_store neg;	/* by magnitude */
+	uint64_t zero;
+	uint64_t n;
+	double min, max, sum;
+};
+
+extern void sketch_init(struct sketch *s);
+extern void sketch_add(struct sketch *s, double v);
+extern double sketch_quantile(struct sketch *s, double q);
+extern double sketch_mean(struct sketch *s);
+#endif
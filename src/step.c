@@ -0,0 +1,366 @@
+/*
+ * step.c: governor step response analysis (--step-response)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include "step.h"
+#include "control.h"
+#include "logger.h"
+
+/*
+ * Stressed cpus alternate between the low and high load level, one
+ * period each, starting with a period at low that is not analyzed. An
+ * edge is posted to the workers' mailboxes and lands on their next tick,
+ * so edge time is taken as the next point of the common tick grid (exact
+ * for --phase in). Sampling runs at STEP_FAST_POLL_MS for up to half a
+ * period after each edge, then at the regular poll.
+ *
+ * Per edge and per signal (Freq, Load, package power), with y0 the
+ * steady value before the edge and yf the one after, both the mean of
+ * the last quarter of their period, and r = (y - y0) / (yf - y0):
+ *	latency		edge to first r >= 0.1
+ *	rise		r >= 0.1 to first r >= 0.9
+ *	overshoot	max r - 1, in % of the step
+ *	settle		edge to staying within |r - 1| <= 0.05 for good
+ * A signal that moved less than STEP_MIN_CHANGE of yf has no response.
+ */
+#define STEP_MIN_CHANGE (0.02)
+#define TICK_MS (IA_TICK_USEC / 1000)
+
+enum step_signal { SIG_FREQ, SIG_LOAD, SIG_POWER, NR_SIGNALS };
+enum step_metric { M_LATENCY, M_RISE, M_OVERSHOOT, M_SETTLE, NR_METRICS };
+
+static const char *signal_name[NR_SIGNALS] = { "freq", "load", "power" };
+static const char *metric_name[NR_METRICS] = {
+	"latency_ms", "rise_ms", "overshoot_pct", "settle_ms",
+};
+
+struct step_sample {
+	double t_ms;		/* since the edge */
+	double v[NR_SIGNALS];
+};
+
+/* m[][] of edge k (1 based) is in results[k - 1]. odd k rise */
+struct edge_result {
+	double y0[NR_SIGNALS], yf[NR_SIGNALS];
+	double m[NR_SIGNALS][NR_METRICS];
+};
+
+static int step_enabled;
+static int nr_edges;
+static int slow_poll_ms;
+static double period_ms, capture_ms;
+static struct edge_result *results;
+
+/* sampling context only */
+static int edge = -1;		/* 0: warm up at low */
+static double edge_ms, next_edge_ms;
+static int fast;
+static struct step_sample *buf;
+static int buf_n, buf_max;
+static double y_prev[NR_SIGNALS];
+
+int initialize_step(struct config *cfg)
+{
+	if (!cfg->step_period_ms)
+		return 1;
+	if (cfg->scenario_file[0] || cfg->sweep) {
+		printf("--step-response excludes --scenario and --sweep\n");
+		return 0;
+	}
+
+	nr_edges = cfg->step_edges ? cfg->step_edges : STEP_DEFAULT_EDGES;
+	period_ms = cfg->step_period_ms;
+	capture_ms = period_ms / 2 < STEP_CAPTURE_MAX_MS ?
+				period_ms / 2 : STEP_CAPTURE_MAX_MS;
+	/* the steady quarter of a period needs a few samples */
+	slow_poll_ms = cfg->poll_period;
+	if (slow_poll_ms > period_ms / 8)
+		slow_poll_ms = period_ms / 8 > STEP_FAST_POLL_MS ?
+				period_ms / 8 : STEP_FAST_POLL_MS;
+
+	results = calloc(nr_edges, sizeof(struct edge_result));
+	if (!results) {
+		perror("calloc step results");
+		return 0;
+	}
+	step_enabled = 1;
+	return 1;
+}
+
+static double package_mw(void)
+{
+	int i;
+	double mw = 0;
+
+	for (i = PKG0_POWER_RAPL; i <= PKG3_POWER_RAPL; i++) {
+		if (col_desc[i].report_enabled)
+			mw += col_desc[i].value;
+	}
+	return mw;
+}
+
+static void set_level(float load)
+{
+	data_t step;
+	int c;
+
+	memset(&step, 0, sizeof(step));
+	step.psn = SINGLE_STEP;
+	step.psa.single_step.v_units = load;
+	for (c = 0; c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, &configpv.cpumask) &&
+				!(c == 0 && dont_stress_cpu0))
+			control_set_shape(c, &step);
+	}
+}
+
+/* mean of each signal over the last quarter of the period */
+static void steady(double *y)
+{
+	int i, s, n = 0;
+
+	for (s = 0; s < NR_SIGNALS; s++)
+		y[s] = 0;
+	for (i = 0; i < buf_n; i++) {
+		if (buf[i].t_ms < period_ms * 3 / 4)
+			continue;
+		for (s = 0; s < NR_SIGNALS; s++)
+			y[s] += buf[i].v[s];
+		n++;
+	}
+	for (s = 0; s < NR_SIGNALS; s++)
+		y[s] = n ? y[s] / n : NAN;
+}
+
+static void analyze(struct edge_result *r, int s)
+{
+	double d = r->yf[s] - r->y0[s], x, peak = -INFINITY;
+	double t10 = NAN, t90 = NAN, settle = 0;
+	int i;
+
+	for (i = 0; i < NR_METRICS; i++)
+		r->m[s][i] = NAN;
+	if (!isfinite(d) || fabs(d) < fabs(r->yf[s]) * STEP_MIN_CHANGE ||
+						fabs(d) < 1e-9)
+		return;
+
+	for (i = 0; i < buf_n; i++) {
+		x = (buf[i].v[s] - r->y0[s]) / d;
+		if (isnan(t10) && x >= 0.1)
+			t10 = buf[i].t_ms;
+		if (isnan(t90) && x >= 0.9)
+			t90 = buf[i].t_ms;
+		if (x > peak)
+			peak = x;
+		/* settled from the next sample on, unless it strays again */
+		if (fabs(x - 1) > 0.05)
+			settle = i + 1 < buf_n ? buf[i + 1].t_ms : NAN;
+	}
+	r->m[s][M_LATENCY] = t10;
+	r->m[s][M_RISE] = t90 - t10;
+	r->m[s][M_OVERSHOOT] = peak > 1 ? (peak - 1) * 100 : 0;
+	r->m[s][M_SETTLE] = settle;
+}
+
+static void next_edge(double now_ms)
+{
+	char text[MAX_MARK_LEN];
+	float load;
+
+	edge++;
+	load = (edge & 1) ? configpv.step_high : configpv.step_low;
+	set_level(load);
+	edge_ms = (floor(now_ms / TICK_MS) + 1) * TICK_MS;
+	next_edge_ms = edge_ms + period_ms;
+	buf_n = 0;
+	set_poll_period(STEP_FAST_POLL_MS);
+	fast = 1;
+
+	snprintf(text, sizeof(text), "step %d/%d: load %.1f at %.0f",
+			edge, nr_edges, load, edge_ms);
+	control_mark(text);
+}
+
+/* sampling context, once a record's column values are final */
+void step_sample(void)
+{
+	double now_ms = col_desc[TIME_STAMP_MS].value;
+	struct step_sample *grown, *p;
+	struct edge_result *r;
+	int s;
+
+	if (!step_enabled || exit_cpu_thread)
+		return;
+
+	if (edge < 0) {
+		next_edge(now_ms);
+		return;
+	}
+
+	if (now_ms > edge_ms) {
+		if (buf_n == buf_max) {
+			buf_max = buf_max ? buf_max * 2 : 1024;
+			grown = realloc(buf, buf_max * sizeof(*buf));
+			if (!grown) {
+				perror("realloc step samples");
+				step_enabled = 0;
+				return;
+			}
+			buf = grown;
+		}
+		p = &buf[buf_n++];
+		p->t_ms = now_ms - edge_ms;
+		p->v[SIG_FREQ] = col_desc[FREQ_REALIZED].value;
+		p->v[SIG_LOAD] = col_desc[LOAD_REALIZED].value;
+		p->v[SIG_POWER] = col_desc[PKG0_POWER_RAPL].report_enabled ?
+							package_mw() : NAN;
+	}
+
+	if (fast && now_ms - edge_ms >= capture_ms) {
+		set_poll_period(slow_poll_ms);
+		fast = 0;
+	}
+	if (now_ms < next_edge_ms)
+		return;
+
+	if (edge > 0) {
+		r = &results[edge - 1];
+		memcpy(r->y0, y_prev, sizeof(y_prev));
+		steady(r->yf);
+		for (s = 0; s < NR_SIGNALS; s++)
+			analyze(r, s);
+		memcpy(y_prev, r->yf, sizeof(y_prev));
+	} else {
+		steady(y_prev);
+	}
+
+	if (edge == nr_edges) {
+		edge++;
+		printf("step response done\n");
+		exit_cpu_thread = 1;
+		return;
+	}
+	next_edge(now_ms);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* to stdout and to <log-file>.step */
+static void step_print(FILE *fp, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+static void step_print(FILE *fp, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	if (!fp)
+		return;
+	va_start(ap, fmt);
+	vfprintf(fp, fmt, ap);
+	va_end(ap);
+}
+
+/* per edge table to the file, rise/fall aggregates to both */
+void finish_step(struct config *cfg)
+{
+	char path[MAX_LEN + 8];
+	FILE *fp;
+	double *v;
+	int done, e, s, m, dir, n;
+
+	done = edge > nr_edges ? nr_edges : edge - 1;
+	if (!step_enabled || done <= 0)
+		return;
+
+	snprintf(path, sizeof(path), "%s.step", cfg->log_file_name);
+	fp = fopen(path, "w");
+	if (!fp)
+		perror("step table");
+
+	if (fp) {
+		fprintf(fp, "# step response %.1f <-> %.1f, %d ms per level\n",
+				cfg->step_low, cfg->step_high,
+				cfg->step_period_ms);
+		fprintf(fp, "edge, dir");
+		for (s = 0; s < NR_SIGNALS; s++) {
+			fprintf(fp, ", %s_y0, %s_yf", signal_name[s],
+							signal_name[s]);
+			for (m = 0; m < NR_METRICS; m++)
+				fprintf(fp, ", %s_%s", signal_name[s],
+							metric_name[m]);
+		}
+		fprintf(fp, "\n");
+		for (e = 0; e < done; e++) {
+			fprintf(fp, "%d, %s", e + 1, e & 1 ? "fall" : "rise");
+			for (s = 0; s < NR_SIGNALS; s++) {
+				fprintf(fp, ", %.2f, %.2f", results[e].y0[s],
+							results[e].yf[s]);
+				for (m = 0; m < NR_METRICS; m++)
+					fprintf(fp, ", %.1f",
+						results[e].m[s][m]);
+			}
+			fprintf(fp, "\n");
+		}
+	}
+
+	v = malloc(sizeof(double) * done);
+	if (!v) {
+		perror("malloc step stats");
+		goto out;
+	}
+	step_print(fp, "# %-5s %-6s %-14s %5s %9s %9s %9s %9s\n", "dir",
+			"signal", "metric", "n", "mean", "p50", "min", "max");
+	for (dir = 0; dir < 2; dir++) {
+		for (s = 0; s < NR_SIGNALS; s++) {
+			for (m = 0; m < NR_METRICS; m++) {
+				double sum = 0;
+
+				for (e = dir, n = 0; e < done; e += 2) {
+					if (isfinite(results[e].m[s][m])) {
+						v[n++] = results[e].m[s][m];
+						sum += v[n - 1];
+					}
+				}
+				if (!n)
+					continue;
+				qsort(v, n, sizeof(double), cmp_double);
+				step_print(fp, "# %-5s %-6s %-14s %5d %9.1f %9.1f %9.1f %9.1f\n",
+					dir ? "fall" : "rise", signal_name[s],
+					metric_name[m], n, sum / n, v[n / 2],
+					v[0], v[n - 1]);
+			}
+		}
+	}
+	free(v);
+out:
+	if (fp) {
+		fclose(fp);
+		printf("step response table written to %s\n", path);
+	}
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _STEP_H_
+#define _STEP_H_
+#include "parse_config.h"
+
+/* poll period right after an edge, and for how long */
+#define STEP_FAST_POLL_MS (2)
+#define STEP_CAPTURE_MAX_MS (1000)
+#define STEP_DEFAULT_EDGES (20)
+
+extern int initialize_step(struct config *cfg);
+extern void step_sample(void);
+extern void finish_step(struct config *cfg);
+#endif
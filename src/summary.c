@@ -0,0 +1,296 @@
+/*
+ * summary.c: end-of-run statistics of every column as a json report
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "summary.h"
+#include "sketch.h"
+#include "logger.h"
+#include "perf_msr.h"
+#include "selfstat.h"
+#include "fallback.h"
+
+/* per-cpu distributions: 1% load bins, 100MHz frequency bins */
+#define LOAD_BINS (101)
+#define FREQ_BIN_MHZ (100)
+#define FREQ_BINS (80)
+
+struct cpu_dist {
+	uint32_t load[LOAD_BINS];
+	uint32_t freq[FREQ_BINS];
+	uint64_t load_n, freq_n;
+	double load_sum, freq_sum;
+};
+
+struct above_ctr {
+	int col;
+	double value;
+	double time_ms;
+	uint64_t samples;
+};
+
+static struct sketch *col_sketch[MAX_COL_NUM];
+static struct cpu_dist *cpu_dist;
+static struct above_ctr above[MAX_THRESHOLDS];
+static int nr_above;
+static uint64_t nr_samples;
+static double last_ms = -1;
+static int summary_enabled;
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char *quantile_name[] = {"p50", "p90", "p99", "p99.9"};
+
+int initialize_summary(struct config *cfg)
+{
+	int i;
+
+	if (!cfg->summary_file[0])
+		return 1;
+
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (!col_desc[i].report_enabled || i == TIME_STAMP_MS)
+			continue;
+		col_sketch[i] = malloc(sizeof(struct sketch));
+		if (!col_sketch[i]) {
+			perror("malloc sketch");
+			return 0;
+		}
+		sketch_init(col_sketch[i]);
+	}
+
+	cpu_dist = calloc(nr_threads, sizeof(struct cpu_dist));
+	if (!cpu_dist) {
+		perror("calloc cpu_dist");
+		return 0;
+	}
+
+	for (i = 0; i < cfg->nr_above; i++) {
+		above[i].col = find_column(cfg->above_col[i]);
+		if (above[i].col < 0 || !col_desc[above[i].col].report_enabled) {
+			printf("--above: no such column %s\n", cfg->above_col[i]);
+			return 0;
+		}
+		above[i].value = cfg->above_val[i];
+	}
+	nr_above = cfg->nr_above;
+	summary_enabled = 1;
+	return 1;
+}
+
+static void hist_add(uint32_t *hist, int bins, double v, double bin_width)
+{
+	int b = (int)(v / bin_width);
+
+	if (b < 0)
+		b = 0;
+	if (b >= bins)
+		b = bins - 1;
+	hist[b]++;
+}
+
+/* called from the logging context once column values are final */
+void summary_sample(void)
+{
+	int i, t;
+	double now_ms, interval;
+	float load, freq;
+
+	if (!summary_enabled)
+		return;
+
+	now_ms = col_desc[TIME_STAMP_MS].value;
+	interval = (last_ms < 0) ? 0 : now_ms - last_ms;
+	last_ms = now_ms;
+	nr_samples++;
+
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		if (col_sketch[i])
+			sketch_add(col_sketch[i], col_desc[i].value);
+	}
+
+	/* a sample's values describe the interval leading up to it */
+	for (i = 0; i < nr_above; i++) {
+		if (col_desc[above[i].col].value > above[i].value) {
+			above[i].time_ms += interval;
+			above[i].samples++;
+		}
+	}
+
+	if (!perf_stats[0].dev_msr_supported && !perf_fallback)
+		return;
+
+	for (t = 0; t < nr_threads; t++) {
+		struct cpu_dist *d = &cpu_dist[t];
+
+		/* no counters were read: fallback has load/freq w/o tsc */
+		if (!perf_diffs.tsc[t] && !perf_fallback)
+			continue;
+		load = perf_diffs.load[t];
+		hist_add(d->load, LOAD_BINS, load, 1);
+		d->load_sum += load;
+		d->load_n++;
+
+		if (!perf_diffs.mperf[t] && !perf_fallback)
+			continue;
+		freq = perf_diffs.freq[t];
+		hist_add(d->freq, FREQ_BINS, freq, FREQ_BIN_MHZ);
+		d->freq_sum += freq;
+		d->freq_n++;
+	}
+}
+
+/* json has no nan/inf */
+static void json_num(FILE *fp, double v)
+{
+	if (isfinite(v))
+		fprintf(fp, "%.3f", v);
+	else
+		fprintf(fp, "null");
+}
+
+static double hist_quantile(uint32_t *hist, int bins, uint64_t n,
+					double q, double bin_width)
+{
+	int b;
+	uint64_t cum = 0;
+
+	if (!n)
+		return NAN;
+	for (b = 0; b < bins; b++) {
+		cum += hist[b];
+		if (cum > q * (n - 1))
+			break;
+	}
+	/* bin center */
+	return (b + 0.5) * bin_width;
+}
+
+static void json_hist(FILE *fp, const char *name, uint32_t *hist, int bins,
+			uint64_t n, double sum, double bin_width)
+{
+	int b, q;
+
+	fprintf(fp, "\"%s\": {\"mean\": ", name);
+	json_num(fp, n ? sum / n : NAN);
+	for (q = 0; q < 3; q++) {
+		fprintf(fp, ", \"%s\": ", quantile_name[q]);
+		json_num(fp, hist_quantile(hist, bins, n, quantiles[q],
+							bin_width));
+	}
+	fprintf(fp, ", \"bin_width\": %.0f, \"hist\": [", bin_width);
+	for (b = 0; b < bins; b++)
+		fprintf(fp, "%s%u", b ? "," : "", hist[b]);
+	fprintf(fp, "]}");
+}
+
+void finish_summary(struct config *cfg)
+{
+	int i, q, t, first;
+	FILE *fp;
+	struct sketch *s;
+	char unit[32];
+
+	if (!summary_enabled)
+		return;
+
+	fp = fopen(cfg->summary_file, "w");
+	if (!fp) {
+		perror("summary file");
+		return;
+	}
+
+	fprintf(fp, "{\n\t\"version\": \"%s\",\n", VERSION);
+	fprintf(fp, "\t\"duration_ms\": %.0f,\n", last_ms < 0 ? 0 : last_ms);
+	fprintf(fp, "\t\"poll_period_ms\": %d,\n", cfg->poll_period);
+	fprintf(fp, "\t\"samples\": %llu,\n", (unsigned long long)nr_samples);
+	fprintf(fp, "\t\"shape\": \"%s\",\n", cfg->shape_func);
+
+	fprintf(fp, "\t\"energy_uj\": {");
+	first = 1;
+	for (i = PKG0_POWER_RAPL; i <= PKG3_POWER_RAPL; i++) {
+		if (!col_desc[i].report_enabled)
+			continue;
+		fprintf(fp, "%s\"package-%d\": %llu", first ? "" : ", ",
+			i - PKG0_POWER_RAPL,
+			(unsigned long long)soc_total_uj[i - PKG0_POWER_RAPL]);
+		first = 0;
+	}
+	if (col_desc[PP0_POWER_RAPL].report_enabled)
+		fprintf(fp, "%s\"core\": %llu", first ? "" : ", ",
+				(unsigned long long)pp0_total_uj);
+	fprintf(fp, "},\n");
+
+	fprintf(fp, "\t\"columns\": {");
+	first = 1;
+	for (i = 0; i < MAX_COL_NUM; i++) {
+		s = col_sketch[i];
+		if (!s)
+			continue;
+		/* "[mWatt]" -> "mWatt" */
+		snprintf(unit, sizeof(unit), "%s", col_desc[i].unit + 1);
+		unit[strlen(unit) ? strlen(unit) - 1 : 0] = '\0';
+		fprintf(fp, "%s\n\t\t\"%s\": {\"unit\": \"%s\", \"n\": %llu, ",
+			first ? "" : ",", col_desc[i].header_name, unit,
+			(unsigned long long)s->n);
+		fprintf(fp, "\"min\": ");
+		json_num(fp, s->n ? s->min : NAN);
+		fprintf(fp, ", \"max\": ");
+		json_num(fp, s->n ? s->max : NAN);
+		fprintf(fp, ", \"mean\": ");
+		json_num(fp, sketch_mean(s));
+		for (q = 0; q < 4; q++) {
+			fprintf(fp, ", \"%s\": ", quantile_name[q]);
+			json_num(fp, sketch_quantile(s, quantiles[q]));
+		}
+		fprintf(fp, "}");
+		first = 0;
+	}
+	fprintf(fp, "\n\t},\n");
+
+	fprintf(fp, "\t\"time_above\": [");
+	for (i = 0; i < nr_above; i++) {
+		fprintf(fp, "%s\n\t\t{\"column\": \"%s\", \"threshold\": ",
+			i ? "," : "", col_desc[above[i].col].header_name);
+		json_num(fp, above[i].value);
+		fprintf(fp, ", \"time_ms\": %.0f, \"samples\": %llu}",
+			above[i].time_ms,
+			(unsigned long long)above[i].samples);
+	}
+	fprintf(fp, "%s],\n", nr_above ? "\n\t" : "");
+	selfstat_json(fp);
+
+	fprintf(fp, "\t\"cpus\": [");
+	for (t = 0; (perf_stats[0].dev_msr_supported || perf_fallback) &&
+							t < nr_threads; t++) {
+		struct cpu_dist *d = &cpu_dist[t];
+
+		fprintf(fp, "%s\n\t\t{\"cpu\": %d, ", t ? "," : "",
+							perf_stats[t].cpu);
+		json_hist(fp, "load_pct", d->load, LOAD_BINS, d->load_n,
+							d->load_sum, 1);
+		fprintf(fp, ", ");
+		json_hist(fp, "freq_mhz", d->freq, FREQ_BINS, d->freq_n,
+						d->freq_sum, FREQ_BIN_MHZ);
+		fprintf(fp, "}");
+	}
+	fprintf(fp, "\n\t]\n}\n");
+	fclose(fp);
+	printf("run summary written to %s\n", cfg->summary_file);
+}
@@ -0,0 +1,368 @@
+/*
+ * sweep.c: perf per watt curve over load levels and core counts (--sweep)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include "sweep.h"
+#include "control.h"
+#include "logger.h"
+
+/*
+ * Each operating point (core count, load level) runs single-step at that
+ * level on the first <cores> stressed cpus, the others idle at MIN_LOAD.
+ * A point first settles: package power is averaged over SWEEP_SETTLE_MS
+ * windows until two in a row agree within SWEEP_SETTLE_PCT (or
+ * SWEEP_SETTLE_MAX_MS passed). Then Qperf, power, load and frequency are
+ * averaged over SWEEP_HOLD_MS. Without RAPL a point settles after one
+ * window and the power based figures are nan.
+ */
+struct sweep_point {
+	int cores;
+	float load_rq;
+	double load, freq, qperf, pkg_mw;
+	double settle_ms;
+	int settled;
+};
+
+enum sweep_state { SWEEP_START, SWEEP_SETTLE, SWEEP_HOLD, SWEEP_DONE };
+
+static struct sweep_point *points;
+static int nr_points, nr_levels;
+static int *stressed;		/* cpus in the order cores are added */
+static int nr_stressed;
+static int sweep_enabled;
+
+/* sampling context only */
+static enum sweep_state state = SWEEP_START;
+static int cur;
+static double point_start_ms, win_start_ms, hold_start_ms;
+static double win_mw, prev_win_mw;
+static int win_n;
+static double sum_load, sum_freq, sum_qperf, sum_mw;
+static int hold_n;
+
+int initialize_sweep(struct config *cfg)
+{
+	int c, i, l;
+
+	if (!cfg->sweep)
+		return 1;
+	if (cfg->scenario_file[0]) {
+		printf("--sweep and --scenario both drive the workers\n");
+		return 0;
+	}
+
+	stressed = malloc(sizeof(int) * CPU_SETSIZE);
+	if (!stressed) {
+		perror("malloc sweep cpus");
+		return 0;
+	}
+	for (c = 0; c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, &cfg->cpumask) && !(c == 0 && dont_stress_cpu0))
+			stressed[nr_stressed++] = c;
+	}
+	if (!cfg->nr_sweep_cores) {
+		cfg->sweep_cores[0] = nr_stressed;
+		cfg->nr_sweep_cores = 1;
+	}
+	for (i = 0; i < cfg->nr_sweep_cores; i++) {
+		if (cfg->sweep_cores[i] > nr_stressed) {
+			printf("--sweep: %d cores but %d cpus stressed\n",
+					cfg->sweep_cores[i], nr_stressed);
+			return 0;
+		}
+	}
+
+	nr_levels = (int)((cfg->sweep_to - cfg->sweep_from) /
+						cfg->sweep_step + 1e-3) + 1;
+	nr_points = nr_levels * cfg->nr_sweep_cores;
+	points = calloc(nr_points, sizeof(struct sweep_point));
+	if (!points) {
+		perror("calloc sweep points");
+		return 0;
+	}
+	for (i = 0; i < cfg->nr_sweep_cores; i++) {
+		for (l = 0; l < nr_levels; l++) {
+			points[i * nr_levels + l].cores = cfg->sweep_cores[i];
+			points[i * nr_levels + l].load_rq =
+					cfg->sweep_from + l * cfg->sweep_step;
+		}
+	}
+	sweep_enabled = 1;
+	return 1;
+}
+
+static double package_mw(void)
+{
+	int i;
+	double mw = 0;
+
+	for (i = PKG0_POWER_RAPL; i <= PKG3_POWER_RAPL; i++) {
+		if (col_desc[i].report_enabled)
+			mw += col_desc[i].value;
+	}
+	return mw;
+}
+
+static void start_point(double now_ms)
+{
+	struct sweep_point *p = &points[cur];
+	data_t step, idle;
+	char text[MAX_MARK_LEN];
+	int i;
+
+	memset(&step, 0, sizeof(step));
+	step.psn = SINGLE_STEP;
+	step.psa.single_step.v_units = p->load_rq;
+	idle = step;
+	idle.psa.single_step.v_units = MIN_LOAD;
+	for (i = 0; i < nr_stressed; i++)
+		control_set_shape(stressed[i], i < p->cores ? &step : &idle);
+
+	point_start_ms = win_start_ms = now_ms;
+	win_mw = prev_win_mw = 0;
+	win_n = 0;
+	state = SWEEP_SETTLE;
+
+	snprintf(text, sizeof(text), "sweep %d/%d: cores %d load %.1f",
+			cur + 1, nr_points, p->cores, p->load_rq);
+	control_mark(text);
+}
+
+static void start_hold(double now_ms, int settled)
+{
+	points[cur].settle_ms = now_ms - point_start_ms;
+	points[cur].settled = settled;
+	hold_start_ms = now_ms;
+	sum_load = sum_freq = sum_qperf = sum_mw = 0;
+	hold_n = 0;
+	state = SWEEP_HOLD;
+}
+
+static void settle_sample(double now_ms)
+{
+	double mean;
+
+	win_mw += package_mw();
+	win_n++;
+	if (now_ms - win_start_ms < SWEEP_SETTLE_MS)
+		return;
+
+	if (!col_desc[PKG0_POWER_RAPL].report_enabled) {
+		start_hold(now_ms, 0);
+		return;
+	}
+	mean = win_mw / win_n;
+	if (prev_win_mw > 0 &&
+	    fabs(mean - prev_win_mw) <= mean * SWEEP_SETTLE_PCT / 100) {
+		start_hold(now_ms, 1);
+		return;
+	}
+	if (now_ms - point_start_ms >= SWEEP_SETTLE_MAX_MS) {
+		start_hold(now_ms, 0);
+		return;
+	}
+	prev_win_mw = mean;
+	win_mw = 0;
+	win_n = 0;
+	win_start_ms = now_ms;
+}
+
+/* sampling context, once a record's column values are final */
+void sweep_sample(void)
+{
+	double now_ms = col_desc[TIME_STAMP_MS].value;
+	struct sweep_point *p;
+
+	if (!sweep_enabled || exit_cpu_thread)
+		return;
+
+	switch (state) {
+	case SWEEP_START:
+		start_point(now_ms);
+		return;
+	case SWEEP_SETTLE:
+		settle_sample(now_ms);
+		return;
+	case SWEEP_HOLD:
+		break;
+	case SWEEP_DONE:
+		return;
+	}
+
+	sum_load += col_desc[LOAD_REALIZED].value;
+	sum_freq += col_desc[FREQ_REALIZED].value;
+	sum_qperf += col_desc[NORM_PERF].value;
+	sum_mw += package_mw();
+	hold_n++;
+	if (now_ms - hold_start_ms < SWEEP_HOLD_MS)
+		return;
+
+	p = &points[cur];
+	p->load = sum_load / hold_n;
+	p->freq = sum_freq / hold_n;
+	p->qperf = sum_qperf / hold_n;
+	p->pkg_mw = col_desc[PKG0_POWER_RAPL].report_enabled ?
+						sum_mw / hold_n : NAN;
+	if (++cur == nr_points) {
+		state = SWEEP_DONE;
+		printf("sweep done\n");
+		exit_cpu_thread = 1;
+		return;
+	}
+	start_point(now_ms);
+}
+
+/*
+ * least squares pkg_mw = a + b*qperf + c*qperf^2 over the points of one
+ * core count, by Gauss-Jordan on the 3x3 normal equations
+ */
+static int fit_quadratic(struct sweep_point *pt, int n, double *coef,
+			 double *r2)
+{
+	double m[3][4] = {{0}};
+	double x, y, xp[5], f, mean_y = 0, ss_res = 0, ss_tot = 0;
+	int i, j, k, r;
+
+	for (i = 0; i < n; i++) {
+		x = pt[i].qperf;
+		y = pt[i].pkg_mw;
+		xp[0] = 1;
+		for (k = 1; k < 5; k++)
+			xp[k] = xp[k - 1] * x;
+		for (j = 0; j < 3; j++) {
+			for (k = 0; k < 3; k++)
+				m[j][k] += xp[j + k];
+			m[j][3] += xp[j] * y;
+		}
+		mean_y += y / n;
+	}
+
+	for (j = 0; j < 3; j++) {
+		/* partial pivot */
+		for (r = j + 1, k = j; r < 3; r++) {
+			if (fabs(m[r][j]) > fabs(m[k][j]))
+				k = r;
+		}
+		for (i = 0; i < 4; i++) {
+			f = m[j][i];
+			m[j][i] = m[k][i];
+			m[k][i] = f;
+		}
+		if (fabs(m[j][j]) < 1e-12)
+			return 0;
+		for (r = 0; r < 3; r++) {
+			if (r == j)
+				continue;
+			f = m[r][j] / m[j][j];
+			for (i = j; i < 4; i++)
+				m[r][i] -= f * m[j][i];
+		}
+	}
+	for (j = 0; j < 3; j++)
+		coef[j] = m[j][3] / m[j][j];
+
+	for (i = 0; i < n; i++) {
+		x = pt[i].qperf;
+		f = coef[0] + coef[1] * x + coef[2] * x * x;
+		ss_res += (pt[i].pkg_mw - f) * (pt[i].pkg_mw - f);
+		ss_tot += (pt[i].pkg_mw - mean_y) * (pt[i].pkg_mw - mean_y);
+	}
+	*r2 = ss_tot > 0 ? 1 - ss_res / ss_tot : NAN;
+	return 1;
+}
+
+/* to stdout and to <log-file>.sweep */
+static void sweep_print(FILE *fp, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+static void sweep_print(FILE *fp, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	if (!fp)
+		return;
+	va_start(ap, fmt);
+	vfprintf(fp, fmt, ap);
+	va_end(ap);
+}
+
+/* table of what was measured, also after ^C */
+void finish_sweep(struct config *cfg)
+{
+	char path[MAX_LEN + 8];
+	FILE *fp;
+	struct sweep_point *p, *best = NULL;
+	double coef[3], r2, ppw;
+	int i, c;
+
+	if (!sweep_enabled || !cur)
+		return;
+
+	snprintf(path, sizeof(path), "%s.sweep", cfg->log_file_name);
+	fp = fopen(path, "w");
+	if (!fp)
+		perror("sweep table");
+
+	sweep_print(fp, "# sweep %.1f:%.1f:%.1f, settle %d%% over %dms windows (max %dms), hold %dms\n",
+			cfg->sweep_from, cfg->sweep_to, cfg->sweep_step,
+			SWEEP_SETTLE_PCT, SWEEP_SETTLE_MS, SWEEP_SETTLE_MAX_MS,
+			SWEEP_HOLD_MS);
+	sweep_print(fp, "%6s, %8s, %8s, %9s, %10s, %10s, %11s, %10s\n",
+			"cores", "LoadRq", "Load", "Freq", "Qperf", "pwrPkg",
+			"Qperf/W", "settle_ms");
+	for (i = 0; i < cur; i++) {
+		p = &points[i];
+		ppw = p->qperf * 1000 / p->pkg_mw;
+		sweep_print(fp, "%6d, %8.2f, %8.2f, %9.2f, %10.2f, %10.2f, %11.3f, %9.0f%s\n",
+				p->cores, p->load_rq, p->load, p->freq,
+				p->qperf, p->pkg_mw, ppw, p->settle_ms,
+				p->settled ? " " : "*");
+		if (isfinite(ppw) && (!best ||
+				ppw > best->qperf * 1000 / best->pkg_mw))
+			best = p;
+	}
+	sweep_print(fp, "# *: power not settled within %dms, or no RAPL\n",
+						SWEEP_SETTLE_MAX_MS);
+
+	/* points of one core count are contiguous */
+	for (c = 0; c < cfg->nr_sweep_cores; c++) {
+		p = &points[c * nr_levels];
+		i = cur - c * nr_levels;
+		if (i > nr_levels)
+			i = nr_levels;
+		if (i < 3 || !isfinite(p->pkg_mw) ||
+					!fit_quadratic(p, i, coef, &r2))
+			continue;
+		sweep_print(fp, "# fit cores %d: pwrPkg[mW] = %.4g + %.4g*Qperf + %.4g*Qperf^2, r2 %.4f\n",
+				p->cores, coef[0], coef[1], coef[2], r2);
+	}
+	if (best)
+		sweep_print(fp, "# best Qperf/W %.3f at cores %d LoadRq %.2f\n",
+				best->qperf * 1000 / best->pkg_mw, best->cores,
+				best->load_rq);
+	if (fp) {
+		fclose(fp);
+		printf("sweep table written to %s\n", path);
+	}
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+#include "parse_config.h"
+
+/* settled: mean package power of two back to back windows within PCT */
+#define SWEEP_SETTLE_MS (2000)
+#define SWEEP_SETTLE_PCT (2)
+#define SWEEP_SETTLE_MAX_MS (30000)
+/* operating point is averaged over this long once settled */
+#define SWEEP_HOLD_MS (5000)
+
+extern int initialize_sweep(struct config *cfg);
+extern void sweep_sample(void);
+extern void finish_sweep(struct config *cfg);
+#endif
@@ -0,0 +1,486 @@
+/*
+ * trace_freq.c: frequency & idle timelines from power tracepoints
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "trace_freq.h"
+#include "logger.h"
+
+/*
+ * --trace-freq: a private tracefs instance (instances/psst-<pid>, so
+ * other tracers are left alone) with trace_clock "mono" records
+ * power:cpu_frequency, power:cpu_idle and, with intel_pstate,
+ * power:pstate_sample. At every sample the sampling context drains the
+ * per cpu trace_pipe_raw buffers (reading them needs no IPI), appends
+ * each event to <log-file>.trace and integrates per cpu state over the
+ * interval:
+ *	TrFreq	time weighted mean of the last cpu_frequency of each cpu
+ *	TrIdle	% of the interval cpus spent between cpu_idle entry and exit
+ * both averaged over the --cpumask cpus, counting only time after the
+ * first event seen for a cpu.
+ *
+ * Ring buffer pages are parsed as in libtraceevent's kbuffer: a page
+ * header (time stamp, commit) then events with a 5 bit type_len and a 27
+ * bit time delta. Field offsets come from each event's format file.
+ */
+#define TRACEFS_PATH "/sys/kernel/tracing"
+#define DEBUGFS_TRACING_PATH "/sys/kernel/debug/tracing"
+#define COMMIT_MASK ((1U << 27) - 1)
+#define TYPE_PADDING (29)
+#define TYPE_TIME_EXTEND (30)
+#define TYPE_TIME_STAMP (31)
+#define IDLE_EXIT (0xffffffffU)
+#define TRACE_FILE_BUF (64 * 1024)
+
+enum tp { TP_FREQ, TP_IDLE, TP_PSTATE, NR_TP };
+
+struct tp_desc {
+	const char *name;	/* under events/ */
+	const char *fields[2];	/* value field, cpu field (or NULL) */
+	int required;
+	int id;
+	int off[2], size[2];
+};
+
+static struct tp_desc tps[NR_TP] = {
+	{ "power/cpu_frequency", { "state", "cpu_id" }, 1, -1,
+							{ 0 }, { 0 } },
+	{ "power/cpu_idle", { "state", "cpu_id" }, 1, -1, { 0 }, { 0 } },
+	{ "power/pstate_sample", { "freq", NULL }, 0, -1, { 0 }, { 0 } },
+};
+
+struct cpu_state {
+	uint32_t khz;		/* 0: no cpu_frequency seen yet */
+	int idle;
+	int seen;		/* any event: state below is known */
+	uint64_t last_ns;
+	uint64_t freq_ns, khz_ns, idle_ns, known_ns;
+};
+
+static int trace_enabled;
+static char instance[MAX_LEN];
+static int nr_cpus;
+static int *pipe_fd;
+static struct cpu_state *cpus;
+static int commit_off = 8, commit_size = 8, data_off = 16;
+static char *page;
+static int page_sz;
+static FILE *trace_fp;
+static uint64_t nr_events, nr_lost_pages;
+
+static int write_file(const char *dir, const char *node, const char *val)
+{
+	char path[MAX_LEN + 64];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd == -1)
+		return -1;
+	ret = write(fd, val, strlen(val)) == (ssize_t)strlen(val) ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static char *read_file(const char *dir, const char *node)
+{
+	char path[MAX_LEN + 64];
+	char *buf;
+	FILE *fp;
+	size_t sz;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	fp = fopen(path, "r");
+	if (!fp)
+		return NULL;
+	buf = calloc(1, 8192);
+	if (buf) {
+		sz = fread(buf, 1, 8191, fp);
+		buf[sz] = '\0';
+	}
+	fclose(fp);
+	return buf;
+}
+
+/* "field:unsigned int state;	offset:8;	size:4;..." lines */
+static int format_field(char *fmt, const char *name, int *off, int *size)
+{
+	char *line, *semi, *p;
+	size_t len = strlen(name);
+
+	for (line = strstr(fmt, "field:"); line;
+				line = strstr(line + 1, "field:")) {
+		semi = strchr(line, ';');
+		if (!semi || semi - line < (long)len + 1)
+			continue;
+		p = semi - len;
+		if (strncmp(p, name, len) || (p[-1] != ' ' && p[-1] != '\t'))
+			continue;
+		p = strstr(semi, "offset:");
+		if (!p || sscanf(p, "offset:%d;", off) != 1)
+			return 0;
+		p = strstr(p, "size:");
+		return p && sscanf(p, "size:%d;", size) == 1;
+	}
+	return 0;
+}
+
+static int setup_tp(struct tp_desc *tp)
+{
+	char node[128], *fmt, *p;
+	int i, ok = 1;
+
+	snprintf(node, sizeof(node), "events/%s/format", tp->name);
+	fmt = read_file(instance, node);
+	if (!fmt)
+		return 0;
+	p = strstr(fmt, "ID:");
+	if (!p || sscanf(p, "ID: %d", &tp->id) != 1)
+		ok = 0;
+	for (i = 0; i < 2 && ok; i++) {
+		if (tp->fields[i] && !format_field(fmt, tp->fields[i],
+						&tp->off[i], &tp->size[i]))
+			ok = 0;
+	}
+	free(fmt);
+	snprintf(node, sizeof(node), "events/%s/enable", tp->name);
+	if (!ok || write_file(instance, node, "1")) {
+		tp->id = -1;
+		return 0;
+	}
+	return 1;
+}
+
+static void remove_instance(void)
+{
+	int i;
+	char node[128];
+
+	for (i = 0; i < NR_TP; i++) {
+		snprintf(node, sizeof(node), "events/%s/enable", tps[i].name);
+		write_file(instance, node, "0");
+	}
+	if (rmdir(instance))
+		perror("rmdir trace instance");
+}
+
+int initialize_trace_freq(struct config *cfg)
+{
+	char path[MAX_LEN + 64], *hdr, *cur;
+	struct timespec now;
+	const char *root;
+	int c, i;
+
+	if (!cfg->trace_freq)
+		return 1;
+
+	root = access(TRACEFS_PATH "/instances", F_OK) ? DEBUGFS_TRACING_PATH :
+							TRACEFS_PATH;
+	snprintf(instance, sizeof(instance), "%s/instances/psst-%d", root,
+								getpid());
+	if (mkdir(instance, 0700)) {
+		perror("--trace-freq: tracefs instance");
+		return 0;
+	}
+	if (write_file(instance, "trace_clock", "mono"))
+		printf("--trace-freq: no mono trace_clock, times are off\n");
+
+	hdr = read_file(root, "events/header_page");
+	if (hdr) {
+		if (!format_field(hdr, "commit", &commit_off, &commit_size) ||
+		    !format_field(hdr, "data", &data_off, &i))
+			printf("--trace-freq: odd header_page, assuming 64 bit\n");
+		free(hdr);
+	}
+
+	for (i = 0; i < NR_TP; i++) {
+		if (!setup_tp(&tps[i]) && tps[i].required) {
+			printf("--trace-freq: no %s tracepoint\n", tps[i].name);
+			goto fail;
+		}
+	}
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	page_sz = getpagesize();
+	pipe_fd = malloc(nr_cpus * sizeof(int));
+	cpus = calloc(nr_cpus, sizeof(struct cpu_state));
+	page = malloc(page_sz);
+	if (!pipe_fd || !cpus || !page) {
+		perror("malloc trace_freq");
+		goto fail;
+	}
+
+	snprintf(path, sizeof(path), "%s.trace", cfg->log_file_name);
+	trace_fp = fopen(path, "w");
+	if (!trace_fp) {
+		perror("--trace-freq: timeline file");
+		goto fail;
+	}
+	setvbuf(trace_fp, NULL, _IOFBF, TRACE_FILE_BUF);
+	fprintf(trace_fp, "# Time [ms], cpu, event, value (freq/pstate MHz, idle state or -1 on exit)\n");
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		perror("clock_gettime");
+	for (c = 0; c < nr_cpus; c++) {
+		snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/trace_pipe_raw",
+							instance, c);
+		/* offline cpus have no buffer to read */
+		pipe_fd[c] = open(path, O_RDONLY | O_NONBLOCK);
+
+		/* a cpu that never changes frequency sends no event */
+		snprintf(path, sizeof(path), "cpu%d/cpufreq/scaling_cur_freq",
+									c);
+		cur = read_file("/sys/devices/system/cpu", path);
+		if (cur && atoi(cur) > 0) {
+			cpus[c].khz = atoi(cur);
+			cpus[c].seen = 1;
+			cpus[c].last_ns = (uint64_t)now.tv_sec * NSEC_PER_SEC +
+								now.tv_nsec;
+		}
+		free(cur);
+	}
+	trace_enabled = 1;
+	return 1;
+fail:
+	remove_instance();
+	return 0;
+}
+
+static uint64_t get_field(char *data, int off, int size)
+{
+	uint64_t v = 0;
+
+	switch (size) {
+	case 1:
+		v = *(uint8_t *)(data + off);
+		break;
+	case 2:
+		v = *(uint16_t *)(data + off);
+		break;
+	case 4:
+		v = *(uint32_t *)(data + off);
+		break;
+	case 8:
+		v = *(uint64_t *)(data + off);
+		break;
+	}
+	return v;
+}
+
+/* integrate cpu's current state up to ns */
+static void advance(struct cpu_state *s, uint64_t ns)
+{
+	uint64_t dt;
+
+	if (s->seen && ns > s->last_ns) {
+		dt = ns - s->last_ns;
+		s->known_ns += dt;
+		if (s->idle)
+			s->idle_ns += dt;
+		if (s->khz) {
+			s->freq_ns += dt;
+			s->khz_ns += s->khz * dt / 1000;
+		}
+	}
+	if (ns > s->last_ns)
+		s->last_ns = ns;
+}
+
+static double rel_ms(uint64_t ns)
+{
+	return ((double)ns - ((double)first_tm.tv_sec * NSEC_PER_SEC +
+					first_tm.tv_nsec)) / 1000000;
+}
+
+static void handle_event(int buf_cpu, uint64_t ts, char *data, int len)
+{
+	uint16_t id;
+	uint32_t v;
+	int i, cpu;
+	struct tp_desc *tp;
+	struct cpu_state *s;
+
+	if (len < 2)
+		return;
+	id = *(uint16_t *)data;
+	for (i = 0; i < NR_TP; i++) {
+		if (tps[i].id == id)
+			break;
+	}
+	if (i == NR_TP)
+		return;
+	tp = &tps[i];
+	if (tp->off[0] + tp->size[0] > len ||
+	    (tp->fields[1] && tp->off[1] + tp->size[1] > len))
+		return;
+	v = get_field(data, tp->off[0], tp->size[0]);
+	cpu = tp->fields[1] ? (int)get_field(data, tp->off[1], tp->size[1]) :
+								buf_cpu;
+	if (cpu < 0 || cpu >= nr_cpus)
+		return;
+	nr_events++;
+
+	s = &cpus[cpu];
+	switch (i) {
+	case TP_FREQ:
+		advance(s, ts);
+		s->khz = v;
+		s->seen = 1;
+		fprintf(trace_fp, "%.3f, %d, freq, %u\n", rel_ms(ts), cpu,
+								v / 1000);
+		break;
+	case TP_IDLE:
+		advance(s, ts);
+		s->idle = v != IDLE_EXIT;
+		s->seen = 1;
+		fprintf(trace_fp, "%.3f, %d, idle, %d\n", rel_ms(ts), cpu,
+							(int)v);
+		break;
+	case TP_PSTATE:
+		fprintf(trace_fp, "%.3f, %d, pstate, %u\n", rel_ms(ts), cpu,
+								v / 1000);
+		break;
+	}
+}
+
+static void parse_page(int buf_cpu, int len)
+{
+	uint64_t ts, commit;
+	uint32_t hdr, type_len, delta, ext, elen;
+	char *p, *end;
+
+	if (len < data_off)
+		return;
+	ts = *(uint64_t *)page;
+	commit = get_field(page, commit_off, commit_size);
+	if (commit & ~(uint64_t)COMMIT_MASK)
+		nr_lost_pages++;
+	commit &= COMMIT_MASK;
+	p = page + data_off;
+	end = p + commit;
+	if (end > page + len)
+		end = page + len;
+
+	while (p + 4 <= end) {
+		hdr = *(uint32_t *)p;
+		p += 4;
+		type_len = hdr & 0x1f;
+		delta = hdr >> 5;
+		switch (type_len) {
+		case TYPE_PADDING:
+			if (p + 4 > end || !delta)
+				return;
+			/* discarded event. its delta is not counted */
+			elen = *(uint32_t *)p;
+			p += elen;
+			continue;
+		case TYPE_TIME_EXTEND:
+			if (p + 4 > end)
+				return;
+			ext = *(uint32_t *)p;
+			p += 4;
+			ts += delta + ((uint64_t)ext << 27);
+			continue;
+		case TYPE_TIME_STAMP:
+			if (p + 4 > end)
+				return;
+			ext = *(uint32_t *)p;
+			p += 4;
+			ts = (ts & ~((1ULL << 59) - 1)) |
+				((uint64_t)ext << 27 | delta);
+			continue;
+		case 0:
+			if (p + 4 > end)
+				return;
+			elen = *(uint32_t *)p - 4;
+			p += 4;
+			break;
+		default:
+			elen = type_len * 4;
+			break;
+		}
+		ts += delta;
+		if (p + elen > end)
+			return;
+		handle_event(buf_cpu, ts, p, elen);
+		p += elen;
+	}
+}
+
+/*
+ * Sampling context, with the sample's time. TrFreq/TrIdle cover the
+ * interval since the previous call.
+ */
+void trace_freq_sample(struct timespec *tm)
+{
+	uint64_t now = (uint64_t)tm->tv_sec * NSEC_PER_SEC + tm->tv_nsec;
+	uint64_t khz_ns = 0, freq_ns = 0, idle_ns = 0, known_ns = 0;
+	struct cpu_state *s;
+	int c, sz;
+
+	if (!trace_enabled)
+		return;
+
+	for (c = 0; c < nr_cpus; c++) {
+		if (pipe_fd[c] == -1)
+			continue;
+		while ((sz = read(pipe_fd[c], page, page_sz)) > 0)
+			parse_page(c, sz);
+	}
+
+	for (c = 0; c < nr_cpus; c++) {
+		s = &cpus[c];
+		advance(s, now);
+		if (CPU_ISSET(c, &configpv.cpumask)) {
+			khz_ns += s->khz_ns;
+			freq_ns += s->freq_ns;
+			idle_ns += s->idle_ns;
+			known_ns += s->known_ns;
+		}
+		s->khz_ns = s->freq_ns = s->idle_ns = s->known_ns = 0;
+	}
+	col_desc[TRACE_FREQ].value = freq_ns ? (double)khz_ns / freq_ns : 0;
+	col_desc[TRACE_IDLE].value = known_ns ?
+				(double)idle_ns * 100 / known_ns : 0;
+}
+
+void finish_trace_freq(struct config *cfg)
+{
+	int c;
+
+	if (!trace_enabled)
+		return;
+	trace_enabled = 0;
+	for (c = 0; c < nr_cpus; c++) {
+		if (pipe_fd[c] != -1)
+			close(pipe_fd[c]);
+	}
+	remove_instance();
+	fclose(trace_fp);
+	printf("%llu power events to %s.trace",
+			(unsigned long long)nr_events, cfg->log_file_name);
+	if (nr_lost_pages)
+		printf(", %llu pages with lost events",
+				(unsigned long long)nr_lost_pages);
+	printf("\n");
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _TRACE_FREQ_H_
+#define _TRACE_FREQ_H_
+#include <time.h>
+#include "parse_config.h"
+
+extern int initialize_trace_freq(struct config *cfg);
+extern void trace_freq_sample(struct timespec *tm);
+extern void finish_trace_freq(struct config *cfg);
+#endif
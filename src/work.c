@@ -0,0 +1,186 @@
+/*
+ * work.c: work done in the ON phase, per cpu and per joule (--ops)
+ *
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "work.h"
+#include "logger.h"
+
+/*
+ * Each pass of a worker's ON loop does one op of fixed integer work (see
+ * work_unit()) and counts it in its own data_t. The count is the same
+ * instruction stream on every platform, so ops/J compares BIOS settings,
+ * governors and machines. With --ops the sampler logs:
+ *	Ops	all workers [Mop/s] over the interval
+ *	OpsJ	[Mop/J] of the package energy (all packages)
+ *	OpsJCore	[Mop/J] of the core (PP0) energy
+ *	OpsNN	[Mop/s] of the worker on cpu NN
+ * Per joule is over the span since the energy counter last moved, so it
+ * holds with --col-period. Run totals are printed at exit.
+ */
+#define WORK_COL_WIDTH (8)
+
+static data_t *workers;
+static int nr_workers;
+static int work_enabled;
+static uint64_t *ops_last;
+static double *ops_rate;
+static uint64_t ops_total, ops_pkg_mark, ops_core_mark;
+static uint64_t pkg_uj_mark, core_uj_mark;
+static double run_ms;
+
+/* ON loop context, on the worker's own cpu */
+void work_unit(data_t *d)
+{
+	uint64_t x = d->work_state;
+	int i;
+
+	for (i = 0; i < WORK_UNIT_STEPS; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		x *= 0x2545f4914f6cdd1dULL;
+	}
+	d->work_state = x;
+	/* single writer: a plain store the sampler can read untorn */
+	__atomic_store_n(&d->ops, d->ops + 1, __ATOMIC_RELAXED);
+}
+
+void work_attach(data_t *w, int n)
+{
+	int t;
+
+	for (t = 0; t < n; t++) {
+		w[t].ops = 0;
+		w[t].work_state = 0x9e3779b97f4a7c15ULL + t;
+	}
+	workers = w;
+	nr_workers = n;
+}
+
+int initialize_work(struct config *cfg)
+{
+	if (!cfg->ops)
+		return 1;
+
+	ops_last = calloc(nr_threads, sizeof(uint64_t));
+	ops_rate = calloc(nr_threads, sizeof(double));
+	if (!ops_last || !ops_rate) {
+		perror("calloc ops");
+		return 0;
+	}
+	col_desc[OPS_RATE].report_enabled = 1;
+	col_desc[OPS_PER_J_PKG].report_enabled =
+				col_desc[PKG0_POWER_RAPL].report_enabled;
+	col_desc[OPS_PER_J_CORE].report_enabled =
+				col_desc[PP0_POWER_RAPL].report_enabled;
+	work_enabled = 1;
+	return 1;
+}
+
+static uint64_t pkg_uj(void)
+{
+	uint64_t uj = 0;
+	int p;
+
+	for (p = 0; p < 4; p++) {
+		if (col_desc[PKG0_POWER_RAPL + p].report_enabled)
+			uj += soc_total_uj[p];
+	}
+	return uj;
+}
+
+/* Mop/J since the energy moved last, else the previous value */
+static void per_joule(log_col_t col, uint64_t uj, uint64_t *uj_mark,
+		      uint64_t *ops_mark)
+{
+	if (!col_desc[col].report_enabled || uj <= *uj_mark)
+		return;
+	col_desc[col].value = (double)(ops_total - *ops_mark) /
+						(uj - *uj_mark);
+	*uj_mark = uj;
+	*ops_mark = ops_total;
+}
+
+/* sampling context, once the energy columns of a record are final */
+void work_sample(double interval_ms)
+{
+	uint64_t ops, sum = 0;
+	int t;
+
+	if (!work_enabled)
+		return;
+
+	for (t = 0; t < nr_workers; t++) {
+		ops = __atomic_load_n(&workers[t].ops, __ATOMIC_RELAXED);
+		ops_rate[t] = (double)(ops - ops_last[t]) / interval_ms / 1000;
+		sum += ops - ops_last[t];
+		ops_last[t] = ops;
+	}
+	ops_total += sum;
+	run_ms += interval_ms;
+	col_desc[OPS_RATE].value = (double)sum / interval_ms / 1000;
+	per_joule(OPS_PER_J_PKG, pkg_uj(), &pkg_uj_mark, &ops_pkg_mark);
+	per_joule(OPS_PER_J_CORE, pp0_total_uj, &core_uj_mark, &ops_core_mark);
+}
+
+/* log record bytes the columns may take */
+int work_width(void)
+{
+	return work_enabled ? nr_threads * 32 : 0;
+}
+
+/* header (row 0: names, 1: units) or values, like os_stats_print() */
+int work_print(char *buf, int row, const char *delim)
+{
+	int sz = 0, t;
+
+	if (!work_enabled)
+		return 0;
+	for (t = 0; t < nr_workers; t++) {
+		if (row == 0)
+			sz += sprintf(buf + sz, "%*s%.2d%s", WORK_COL_WIDTH - 2,
+				"Ops", workers[t].affinity_pr, delim);
+		else if (row == 1)
+			sz += sprintf(buf + sz, "%*s%s", WORK_COL_WIDTH,
+							"[Mop/s]", delim);
+		else
+			sz += sprintf(buf + sz, "%*.3f%s", WORK_COL_WIDTH,
+							ops_rate[t], delim);
+	}
+	return sz;
+}
+
+void finish_work(void)
+{
+	uint64_t pkg = pkg_uj(), core = pp0_total_uj;
+
+	if (!work_enabled)
+		return;
+	printf("work: %.3f Mops, %.3f Mop/s", (double)ops_total / 1000000,
+		run_ms > 0 ? ops_total / run_ms / 1000 : 0);
+	if (col_desc[OPS_PER_J_PKG].report_enabled && pkg)
+		printf(", package %.3f Mop/J", (double)ops_total / pkg);
+	if (col_desc[OPS_PER_J_CORE].report_enabled && core)
+		printf(", core %.3f Mop/J", (double)ops_total / core);
+	printf("\n");
+	free(ops_last);
+	free(ops_rate);
+	work_enabled = 0;
+}
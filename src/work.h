@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2017, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Author: Noor ul Mubeen <noor.u.mubeen@intel.com>
+ */
+
+#ifndef _WORK_H_
+#define _WORK_H_
+#include "psst.h"
+#include "parse_config.h"
+
+/* one op: this many steps of a dependent xorshift-multiply chain */
+#define WORK_UNIT_STEPS (256)
+
+extern void work_unit(data_t *d);
+extern void work_attach(data_t *w, int n);
+extern int initialize_work(struct config *cfg);
+extern void work_sample(double interval_ms);
+extern int work_width(void);
+extern int work_print(char *buf, int row, const char *delim);
+extern void finish_work(void);
+#endif